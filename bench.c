@@ -0,0 +1,340 @@
+#define KILO_HEADLESS
+#include "kilo.c"
+
+/*** headless terminal ***/
+
+struct benchScript {
+	int * keys;
+	int numkeys;
+	int cap;
+	int pos;
+};
+
+struct benchScript BS;
+unsigned long benchBytes;
+
+void die(const char * s) {
+	perror(s);
+	exit(1);
+}
+
+int getWindowSize(int * rows, int * cols, int force) {
+	(void) force;
+	*rows = 48;
+	*cols = 160;
+	return 0;
+}
+
+void editorWrite(const char * buf, int len) {
+	(void) buf;
+	benchBytes += len;
+}
+
+int editorReadKey() {
+	if (BS.pos >= BS.numkeys) {
+		fprintf(stderr, "bench: script ran out of keys\n");
+		exit(1);
+	}
+	return BS.keys[BS.pos++];
+}
+
+/*** scripts ***/
+
+double benchSeconds() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void benchPushKey(int key) {
+	if (BS.numkeys == BS.cap) {
+		BS.cap = BS.cap ? BS.cap * 2 : 256;
+		BS.keys = realloc(BS.keys, sizeof(int) * BS.cap);
+	}
+	BS.keys[BS.numkeys++] = key;
+}
+
+/* literal characters, plus {NAME} for special keys and {^X} for Ctrl-X */
+void benchKeys(const char * s) {
+	struct { char * name; int key; } names[] = {
+		{ "UP", ARROW_UP }, { "DOWN", ARROW_DOWN }, { "LEFT", ARROW_LEFT }, { "RIGHT", ARROW_RIGHT },
+		{ "S-UP", SHIFT_ARROW_UP }, { "S-DOWN", SHIFT_ARROW_DOWN }, { "S-LEFT", SHIFT_ARROW_LEFT }, { "S-RIGHT", SHIFT_ARROW_RIGHT },
+		{ "PGUP", PAGE_UP }, { "PGDN", PAGE_DOWN }, { "HOME", HOME_KEY }, { "END", END_KEY },
+		{ "DEL", DEL_KEY }, { "BS", BACKSPACE }, { "ESC", '\x1b' }, { "ENTER", '\r' }, { "TAB", '\t' }
+	};
+
+	while (*s) {
+		if (*s != '{') {
+			benchPushKey(*s++);
+			continue;
+		}
+		const char * end = strchr(s, '}');
+		int len = end - s - 1;
+		if (s[1] == '^' && len == 2) {
+			benchPushKey(CTRL_KEY(s[2]));
+		} else {
+			unsigned int i;
+			for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+				if ((int) strlen(names[i].name) == len && !strncmp(&s[1], names[i].name, len)) break;
+			}
+			if (i == sizeof(names) / sizeof(names[0])) {
+				fprintf(stderr, "bench: unknown key %.*s\n", len, &s[1]);
+				exit(1);
+			}
+			benchPushKey(names[i].key);
+		}
+		s = end + 1;
+	}
+}
+
+/* run the queued keys through the same refresh/keypress loop as main */
+double benchRun(int * numkeys) {
+	*numkeys = BS.numkeys - BS.pos;
+	double t = benchSeconds();
+	while (BS.pos < BS.numkeys) {
+		editorRefreshScreen();
+		editorProcessKeypress();
+	}
+	editorRefreshScreen();
+	BS.numkeys = BS.pos = 0;
+	return benchSeconds() - t;
+}
+
+/*** bench ***/
+
+int benchLine(char * line, int size, int i) {
+	if (i % 5000 == 4700) return snprintf(line, size, "/* block %d opens a comment", i);
+	if (i % 5000 == 4000) return snprintf(line, size, "   closes it */ int after%d = %d;", i, i);
+	if (i % 3 == 0) return snprintf(line, size, "\tif (x%d > %d.5) return \"str %d\"; // note", i, i, i);
+	return snprintf(line, size, "\tstatic unsigned int y%d = sizeof(struct s) * %d;", i, i);
+}
+
+long benchGenerateFile(char * path, int numlines) {
+	FILE * fp = fopen(path, "w");
+	if (fp == NULL) die(path);
+	char line[128];
+	long bytes = 0;
+	for (int i = 0; i < numlines; i++) {
+		int len = benchLine(line, sizeof(line), i);
+		line[len++] = '\n';
+		fwrite(line, 1, len, fp);
+		bytes += len;
+	}
+	fclose(fp);
+	return bytes;
+}
+
+void benchFinishLoads() {
+	for (int i = 0; i < E.filecap; i++) {
+		efile * F = E.file[i];
+		while (F && F->loader) {
+			editorLoadWait(F);
+			if (F->loader == NULL) editorLoadFinished(F);
+		}
+	}
+}
+
+void benchScenario(char * name, int numkeys, double t) {
+	printf("  %-10s %8d %10.1f %12.0f %10lu\n", name, numkeys, t * 1e3, numkeys / t, numkeys ? benchBytes / numkeys : 0);
+	benchBytes = 0;
+}
+
+void benchSuite(int numlines) {
+	char path[256], out[256], buf[128];
+	char * tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	snprintf(path, sizeof(path), "%s/kilo-bench-%d.c", tmp, numlines);
+	snprintf(out, sizeof(out), "%s/kilo-bench-%d.out.c", tmp, numlines);
+	long bytes = benchGenerateFile(path, numlines);
+
+	memset(ST.hist, 0, sizeof(ST.hist));
+	ST.enabled = 1;
+	benchBytes = 0;
+	printf("%d lines, %.1f MB\n", numlines, bytes / 1e6);
+	printf("  %-10s %8s %10s %12s %10s\n", "scenario", "keys", "ms", "keys/s", "bytes/key");
+
+	double t = benchSeconds();
+	editorOpen(path);
+	double first = benchSeconds() - t;
+	benchFinishLoads();
+	t = benchSeconds() - t;
+	printf("  %-10s %8s %10.1f %9.1fMB/s   first screen %.2f ms\n", "open", "-", t * 1e3, bytes / t / 1e6, first * 1e3);
+
+	efile * F = E.file[E.currentfile];
+	free(F->filename);
+	F->filename = strdup(out);
+	int numkeys;
+
+	int pages = numlines / E.screenrows;
+	if (pages > 500) pages = 500;
+	for (int i = 0; i < pages; i++) benchKeys("{PGDN}");
+	for (int i = 0; i < pages; i++) benchKeys("{PGUP}");
+	t = benchRun(&numkeys);
+	benchScenario("scroll", numkeys, t);
+
+	F->cy = F->numrows / 2;
+	F->cx = 0;
+	for (int i = 0; i < 100; i++) benchKeys("int typed = 42; // bench{ENTER}");
+	t = benchRun(&numkeys);
+	benchScenario("type", numkeys, t);
+
+	benchKeys("{HOME}{S-DOWN}{S-DOWN}{S-DOWN}{^c}");
+	for (int i = 0; i < 100; i++) benchKeys("{^v}");
+	t = benchRun(&numkeys);
+	benchScenario("paste", numkeys, t);
+
+	for (int i = 1; i <= 20; i++) {
+		snprintf(buf, sizeof(buf), "{^f}x%d{DOWN}{DOWN}{ENTER}", (int) ((long) numlines * i / 21 / 3 * 3));
+		benchKeys(buf);
+	}
+	t = benchRun(&numkeys);
+	benchScenario("search", numkeys, t);
+
+	benchKeys("{^s}{^s}{^s}");
+	t = benchRun(&numkeys);
+	benchScenario("save", numkeys, t);
+
+	struct { char * name; int stat; } funcs[] = {
+		{ "editorOpen", STAT_OPEN }, { "editorUpdateSyntax", STAT_HIGHLIGHT }, { "editorFindCallback", STAT_FIND },
+		{ "editorDrawRows", STAT_DRAWROWS }, { "editorSave", STAT_SAVE }
+	};
+	printf("  %-20s %9s %9s %9s %8s\n", "function", "p50", "p99", "max", "count");
+	for (unsigned int i = 0; i < sizeof(funcs) / sizeof(funcs[0]); i++) {
+		struct editorHistogram * h = &ST.hist[funcs[i].stat];
+		char p50[16], p99[16], max[16];
+		editorFormatNanos(p50, sizeof(p50), editorHistPercentile(h, 0.50));
+		editorFormatNanos(p99, sizeof(p99), editorHistPercentile(h, 0.99));
+		editorFormatNanos(max, sizeof(max), h->max);
+		printf("  %-20s %9s %9s %9s %8lu\n", funcs[i].name, p50, p99, max, h->count);
+	}
+	printf("\n");
+
+	editorFreeFile(F);
+	unlink(path);
+	unlink(out);
+}
+
+void benchGenerateRows(efile * F, int numrows) {
+	char line[128];
+	erow * rows = malloc(sizeof(erow) * numrows);
+	for (int i = 0; i < numrows; i++) {
+		int len = benchLine(line, sizeof(line), i);
+		editorLoadRow(&rows[i], line, len);
+	}
+	editorAppendRows(F, rows, numrows);
+	free(rows);
+}
+
+int benchSameHighlight(efile * F, unsigned char ** hl, int * open) {
+	for (int i = 0; i < F->numrows; i++) {
+		if (open[i] != F->row[i].hl_open_comment) return 0;
+		if (memcmp(hl[i], F->row[i].hl, F->row[i].rsize)) return 0;
+	}
+	return 1;
+}
+
+void benchHighlight(int numrows) {
+	editorNewFile();
+	efile * F = E.file[E.currentfile];
+	benchGenerateRows(F, numrows);
+	F->syntax = &HLDB[0];
+
+	/* sequential reference */
+	editorPoolFree();
+	editorPoolInit(1);
+	double t = benchSeconds();
+	editorHighlightRows(F, 0, F->numrows);
+	double base = benchSeconds() - t;
+	unsigned char ** hl = malloc(sizeof(unsigned char *) * F->numrows);
+	int * open = malloc(sizeof(int) * F->numrows);
+	for (int i = 0; i < F->numrows; i++) {
+		hl[i] = malloc(F->row[i].rsize);
+		memcpy(hl[i], F->row[i].hl, F->row[i].rsize);
+		open[i] = F->row[i].hl_open_comment;
+	}
+
+	int maxthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (maxthreads < 4) maxthreads = 4;
+	printf("editorHighlightRows, %d rows, %ld cpus\n", numrows, sysconf(_SC_NPROCESSORS_ONLN));
+	printf("%8s %10s %10s %8s %10s\n", "threads", "ms", "Mrows/s", "speedup", "identical");
+	for (int n = 1; n <= maxthreads; n *= 2) {
+		editorPoolFree();
+		editorPoolInit(n);
+		for (int i = 0; i < F->numrows; i++) {
+			memset(F->row[i].hl, HL_NORMAL, F->row[i].rsize);
+			F->row[i].hl_open_comment = 0;
+		}
+		t = benchSeconds();
+		editorHighlightRows(F, 0, F->numrows);
+		t = benchSeconds() - t;
+		printf("%8d %10.1f %10.2f %8.2f %10s\n", n, t * 1e3, numrows / t / 1e6, base / t, benchSameHighlight(F, hl, open) ? "yes" : "NO");
+	}
+
+	for (int i = 0; i < F->numrows; i++) free(hl[i]);
+	free(hl);
+	free(open);
+	editorPoolFree();
+}
+
+/* index a file in the pager, then open it again: the index cached by the
+ * first open must hand every line back before the second returns */
+void benchPager(int numlines) {
+	char dir[256], path[300], line[128];
+	char * tmp = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	snprintf(dir, sizeof(dir), "%s/kilo-bench-XXXXXX", tmp);
+	if (mkdtemp(dir) == NULL) die("mkdtemp");
+	setenv("XDG_CACHE_HOME", dir, 1);
+	snprintf(path, sizeof(path), "%s/pager.c", dir);
+	long bytes = benchGenerateFile(path, numlines);
+
+	printf("editorPagerOpen, %d lines, %.1f MB\n", numlines, bytes / 1e6);
+	printf("%8s %10s %10s %10s %10s\n", "open", "ms", "rows", "indexed", "identical");
+	int ok = 1;
+	for (int pass = 0; pass < 2; pass++) {
+		efile * F = editorCreateFile();
+		int fd = open(path, O_RDONLY);
+		double t = benchSeconds();
+		if (fd == -1 || editorPagerOpen(F, fd) == -1) die(path);
+		int rows = F->numrows;
+		while (editorPagerProgress(F) < 100) usleep(1000);
+		editorPagerPoll(F);
+		t = benchSeconds() - t;
+
+		int len = benchLine(line, sizeof(line), numlines - 1);
+		erow * row = (F->numrows == numlines) ? editorPagerRow(F, numlines - 1) : NULL;
+		int same = row && row->size == len && !memcmp(row->chars, line, len);
+		if (pass == 1 && rows != numlines) same = 0;
+		ok &= same;
+		printf("%8s %10.1f %10d %10d %10s\n", pass ? "cached" : "first", t * 1e3, rows, F->numrows, same ? "yes" : "NO");
+		editorDestroyFile(F);
+	}
+
+	char idx[4096];
+	struct stat st;
+	if (stat(path, &st) == 0 && editorIndexPath(idx, sizeof(idx), &st) == 0) unlink(idx);
+	snprintf(idx, sizeof(idx), "%s/kilo", dir);
+	rmdir(idx);
+	unlink(path);
+	rmdir(dir);
+	if (!ok) exit(1);
+}
+
+int main(int argc, char * argv[]) {
+	initEditor();
+
+	if (argc >= 2 && !strcmp(argv[1], "highlight")) {
+		benchHighlight((argc >= 3) ? atoi(argv[2]) : 1000000);
+	} else if (argc >= 2 && !strcmp(argv[1], "pager")) {
+		benchPager((argc >= 3) ? atoi(argv[2]) : 1000000);
+	} else if (argc <= 1 || !strcmp(argv[1], "suite")) {
+		if (argc <= 2) {
+			int sizes[] = { 1000, 10000, 100000, 1000000 };
+			for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) benchSuite(sizes[i]);
+		} else {
+			for (int i = 2; i < argc; i++) benchSuite(atoi(argv[i]));
+		}
+	} else {
+		fprintf(stderr, "usage: %s [suite [lines...] | highlight [rows] | pager [lines]]\n", argv[0]);
+		return 1;
+	}
+	return 0;
+}
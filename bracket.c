@@ -0,0 +1,415 @@
+#include "kilo.h"
+
+/*** data ***/
+
+struct editorBracketNode {
+	int rows;
+	int dirty;
+	struct editorBracketSum sum;
+};
+
+/* a segment tree over leaves of about KILO_BRACKET_BLOCK rows each, which
+ * split when they grow to twice that and go when they empty */
+struct editorBrackets {
+	struct editorBracketNode * node;
+	int cap;
+	int numleaves;
+	int * dirty;
+	int numdirty;
+	int lastleaf;
+	int lastfirst;
+};
+
+/*** row summaries ***/
+
+/* 1 for an opening bracket, -1 for a closing one and 0 for anything else,
+ * brackets in strings and comments included */
+int editorIsBracket(erow * row, int j) {
+	if (row->hl) {
+		unsigned char hl = row->hl[j];
+		if (hl == HL_STRING || hl == HL_COMMENT || hl == HL_MLCOMMENT) return 0;
+	}
+	switch (row->render[j]) {
+		case '(': case '[': case '{': return 1;
+		case ')': case ']': case '}': return -1;
+	}
+	return 0;
+}
+
+struct editorBracketSum editorBracketJoin(struct editorBracketSum a, struct editorBracketSum b) {
+	struct editorBracketSum s;
+	s.net = a.net + b.net;
+	s.low = (a.net + b.low < a.low) ? a.net + b.low : a.low;
+	return s;
+}
+
+/* summed once the row has its highlighting, so strings and comments are known */
+void editorRowBrackets(erow * row) {
+	int depth = 0, low = 0;
+	for (int j = 0; j < row->rsize; j++) {
+		depth += editorIsBracket(row, j);
+		if (depth < low) low = depth;
+	}
+	row->brackets.net = depth;
+	row->brackets.low = low;
+}
+
+/*** index ***/
+
+/* Row edits mark their leaf dirty, and the next lookup sums the dirty leaves
+ * again; inserts and deletes change the row counts on the path at once, so
+ * finding the leaf of a row stays a descent of the tree */
+
+void editorBracketPull(struct editorBrackets * B, int i) {
+	struct editorBracketNode * l = &B->node[2 * i], * r = &B->node[2 * i + 1];
+	B->node[i].rows = l->rows + r->rows;
+	B->node[i].sum = editorBracketJoin(l->sum, r->sum);
+}
+
+void editorBracketPullAll(struct editorBrackets * B) {
+	for (int i = B->cap - 1; i >= 1; i--) editorBracketPull(B, i);
+}
+
+/* leaf holding row at, and the first row of that leaf */
+int editorBracketLeaf(struct editorBrackets * B, int at, int * first) {
+	if (B->lastleaf != -1 && at >= B->lastfirst && at < B->lastfirst + B->node[B->cap + B->lastleaf].rows) {
+		*first = B->lastfirst;
+		return B->lastleaf;
+	}
+	int total = B->node[1].rows;
+	if (at >= total) {
+		int leaf = B->numleaves - 1;
+		*first = total - B->node[B->cap + leaf].rows;
+		return leaf;
+	}
+	int i = 1, skipped = 0;
+	while (i < B->cap) {
+		if (at - skipped < B->node[2 * i].rows) {
+			i = 2 * i;
+		} else {
+			skipped += B->node[2 * i].rows;
+			i = 2 * i + 1;
+		}
+	}
+	B->lastleaf = i - B->cap;
+	B->lastfirst = skipped;
+	*first = skipped;
+	return B->lastleaf;
+}
+
+/* first row of a leaf, from the rows of the subtrees to its left */
+int editorBracketFirst(struct editorBrackets * B, int leaf) {
+	int first = 0;
+	for (int i = B->cap + leaf; i > 1; i /= 2) {
+		if (i & 1) first += B->node[i - 1].rows;
+	}
+	return first;
+}
+
+void editorBracketSumLeaf(efile * F, int leaf, int first) {
+	struct editorBrackets * B = F->brackets;
+	struct editorBracketNode * n = &B->node[B->cap + leaf];
+	struct editorBracketSum s = {0, 0};
+	for (int i = first; i < first + n->rows; i++) s = editorBracketJoin(s, F->row[i].brackets);
+	n->sum = s;
+	n->dirty = 0;
+}
+
+void editorBracketBuild(efile * F) {
+	struct editorBrackets * B = malloc(sizeof(struct editorBrackets));
+	B->numleaves = (F->numrows + KILO_BRACKET_BLOCK - 1) / KILO_BRACKET_BLOCK;
+	if (B->numleaves == 0) B->numleaves = 1;
+	/* room for leaves to split before it has to be built again */
+	B->cap = 1;
+	while (B->cap < 2 * B->numleaves) B->cap <<= 1;
+	B->node = calloc(2 * B->cap, sizeof(struct editorBracketNode));
+	B->dirty = NULL;
+	B->numdirty = 0;
+	B->lastleaf = -1;
+	F->brackets = B;
+	for (int leaf = 0; leaf < B->numleaves; leaf++) {
+		int first = leaf * KILO_BRACKET_BLOCK;
+		int rows = F->numrows - first;
+		B->node[B->cap + leaf].rows = (rows > KILO_BRACKET_BLOCK) ? KILO_BRACKET_BLOCK : rows;
+		editorBracketSumLeaf(F, leaf, first);
+	}
+	editorBracketPullAll(B);
+}
+
+void editorBracketFree(efile * F) {
+	struct editorBrackets * B = F->brackets;
+	if (B == NULL) return;
+	free(B->node);
+	free(B->dirty);
+	free(B);
+	F->brackets = NULL;
+}
+
+void editorBracketDirty(struct editorBrackets * B, int leaf) {
+	struct editorBracketNode * n = &B->node[B->cap + leaf];
+	if (n->dirty) return;
+	n->dirty = 1;
+	B->dirty = realloc(B->dirty, sizeof(int) * (B->numdirty + 1));
+	B->dirty[B->numdirty++] = leaf;
+}
+
+/* leaves from leaf on move by delta places */
+void editorBracketShiftLeaves(struct editorBrackets * B, int leaf, int delta) {
+	struct editorBracketNode * leaves = &B->node[B->cap];
+	if (delta > 0) {
+		memmove(&leaves[leaf + 1], &leaves[leaf], sizeof(struct editorBracketNode) * (B->numleaves - leaf));
+	} else {
+		memmove(&leaves[leaf], &leaves[leaf + 1], sizeof(struct editorBracketNode) * (B->numleaves - leaf - 1));
+		memset(&leaves[B->numleaves - 1], 0, sizeof(struct editorBracketNode));
+	}
+	B->numleaves += delta;
+	for (int i = 0; i < B->numdirty; i++) {
+		if (B->dirty[i] > leaf || (delta > 0 && B->dirty[i] == leaf)) B->dirty[i] += delta;
+	}
+	B->lastleaf = -1;
+	editorBracketPullAll(B);
+}
+
+void editorBracketAddRows(struct editorBrackets * B, int leaf, int delta) {
+	for (int i = B->cap + leaf; i >= 1; i /= 2) B->node[i].rows += delta;
+}
+
+/* twice the room for leaves, the leaves moved over as they are */
+void editorBracketGrow(struct editorBrackets * B) {
+	struct editorBracketNode * node = calloc(4 * B->cap, sizeof(struct editorBracketNode));
+	memcpy(&node[2 * B->cap], &B->node[B->cap], sizeof(struct editorBracketNode) * B->numleaves);
+	free(B->node);
+	B->node = node;
+	B->cap *= 2;
+	B->lastleaf = -1;
+	editorBracketPullAll(B);
+}
+
+/* a row was inserted at at, before the rows from there on moved down */
+void editorBracketInsert(efile * F, int at) {
+	struct editorBrackets * B = F->brackets;
+	if (B == NULL) return;
+	int first;
+	int leaf = editorBracketLeaf(B, at, &first);
+	editorBracketAddRows(B, leaf, 1);
+	editorBracketDirty(B, leaf);
+	B->lastleaf = -1;
+
+	int rows = B->node[B->cap + leaf].rows;
+	if (rows <= 2 * KILO_BRACKET_BLOCK) return;
+	if (B->numleaves == B->cap) editorBracketGrow(B);
+	editorBracketShiftLeaves(B, leaf + 1, 1);
+	B->node[B->cap + leaf].rows = rows / 2;
+	B->node[B->cap + leaf + 1].rows = rows - rows / 2;
+	B->node[B->cap + leaf + 1].dirty = 0;
+	editorBracketDirty(B, leaf + 1);
+	editorBracketPullAll(B);
+}
+
+void editorBracketDelete(efile * F, int at) {
+	struct editorBrackets * B = F->brackets;
+	if (B == NULL) return;
+	int first;
+	int leaf = editorBracketLeaf(B, at, &first);
+	editorBracketAddRows(B, leaf, -1);
+	B->lastleaf = -1;
+	if (B->node[B->cap + leaf].rows == 0 && B->numleaves > 1) {
+		for (int i = 0; i < B->numdirty; i++) {
+			if (B->dirty[i] == leaf) B->dirty[i] = B->dirty[--B->numdirty];
+		}
+		editorBracketShiftLeaves(B, leaf, -1);
+	} else {
+		editorBracketDirty(B, leaf);
+	}
+}
+
+/* the row at was highlighted again in place */
+void editorBracketTouch(efile * F, int at) {
+	struct editorBrackets * B = F->brackets;
+	if (B == NULL) return;
+	int first;
+	editorBracketDirty(B, editorBracketLeaf(B, at, &first));
+}
+
+/* rows start to end were highlighted in bulk: those the index has are
+ * marked dirty, and rows appended past its end fill up the last leaf and
+ * then new ones, so loading and following never rebuild it */
+void editorBracketRange(efile * F, int start, int end) {
+	struct editorBrackets * B = F->brackets;
+	if (B == NULL) return;
+	int total = B->node[1].rows;
+	int first;
+	int leaf = (start < total) ? editorBracketLeaf(B, start, &first) : B->numleaves - 1;
+	int stop = (end < total) ? editorBracketLeaf(B, end - 1, &first) : B->numleaves - 1;
+	for (; leaf <= stop; leaf++) editorBracketDirty(B, leaf);
+
+	leaf = B->numleaves - 1;
+	while (total < end) {
+		int rows = B->node[B->cap + leaf].rows;
+		if (rows >= KILO_BRACKET_BLOCK) {
+			if (B->numleaves == B->cap) editorBracketGrow(B);
+			leaf = B->numleaves++;
+			rows = 0;
+		}
+		int add = (end - total < KILO_BRACKET_BLOCK - rows) ? end - total : KILO_BRACKET_BLOCK - rows;
+		editorBracketAddRows(B, leaf, add);
+		editorBracketDirty(B, leaf);
+		total += add;
+	}
+	B->lastleaf = -1;
+}
+
+/* the index brought up to date for a lookup, built on first use */
+struct editorBrackets * editorBracketIndex(efile * F) {
+	if (F->brackets == NULL) editorBracketBuild(F);
+	struct editorBrackets * B = F->brackets;
+	for (int i = 0; i < B->numdirty; i++) {
+		int leaf = B->dirty[i];
+		editorBracketSumLeaf(F, leaf, editorBracketFirst(B, leaf));
+		for (int j = (B->cap + leaf) / 2; j >= 1; j /= 2) editorBracketPull(B, j);
+	}
+	B->numdirty = 0;
+	return B;
+}
+
+/* first leaf from on where a depth of *d runs out; *d is lowered and *first
+ * moved on by the subtrees passed over whole */
+int editorBracketForward(struct editorBrackets * B, int node, int lo, int hi, int from, int * d, int * first) {
+	if (hi < from) return -1;
+	struct editorBracketNode * n = &B->node[node];
+	if (lo >= from && *d + n->sum.low > 0) {
+		*d += n->sum.net;
+		*first += n->rows;
+		return -1;
+	}
+	if (lo == hi) return lo;
+	int mid = lo + (hi - lo) / 2;
+	int leaf = editorBracketForward(B, 2 * node, lo, mid, from, d, first);
+	if (leaf != -1) return leaf;
+	return editorBracketForward(B, 2 * node + 1, mid + 1, hi, from, d, first);
+}
+
+/* last leaf up to to where *d opening brackets are found walking back; *end
+ * is moved back over the subtrees passed */
+int editorBracketBackward(struct editorBrackets * B, int node, int lo, int hi, int to, int * d, int * end) {
+	if (lo > to) return -1;
+	struct editorBracketNode * n = &B->node[node];
+	if (hi <= to && n->sum.net - n->sum.low < *d) {
+		*d -= n->sum.net;
+		*end -= n->rows;
+		return -1;
+	}
+	if (lo == hi) return lo;
+	int mid = lo + (hi - lo) / 2;
+	int leaf = editorBracketBackward(B, 2 * node + 1, mid + 1, hi, to, d, end);
+	if (leaf != -1) return leaf;
+	return editorBracketBackward(B, 2 * node, lo, mid, to, d, end);
+}
+
+/*** lookups ***/
+
+/* where a depth of d after render column rx of row cy drops to 0: the rest
+ * of the row is scanned, then the rows of its leaf by their sums, then the
+ * tree finds the leaf, and its rows and the row found are scanned again */
+int editorBracketScanForward(efile * F, int cy, int rx, int d, int * my, int * mrx) {
+	erow * row = &F->row[cy];
+	for (int j = rx + 1; j < row->rsize; j++) {
+		d += editorIsBracket(row, j);
+		if (d == 0) {
+			*my = cy;
+			*mrx = j;
+			return 0;
+		}
+	}
+
+	struct editorBrackets * B = editorBracketIndex(F);
+	int first;
+	int leaf = editorBracketLeaf(B, cy, &first);
+	int end = first + B->node[B->cap + leaf].rows;
+	int r = cy + 1;
+	while (r < end && d + F->row[r].brackets.low > 0) d += F->row[r++].brackets.net;
+	if (r == end) {
+		if (r >= F->numrows) return -1;
+		leaf = editorBracketForward(B, 1, 0, B->cap - 1, leaf + 1, &d, &r);
+		if (leaf == -1) return -1;
+		while (r < F->numrows && d + F->row[r].brackets.low > 0) d += F->row[r++].brackets.net;
+		if (r == F->numrows) return -1;
+	}
+
+	row = &F->row[r];
+	for (int j = 0; j < row->rsize; j++) {
+		d += editorIsBracket(row, j);
+		if (d == 0) {
+			*my = r;
+			*mrx = j;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* where d opening brackets are found walking back from before rx */
+int editorBracketScanBackward(efile * F, int cy, int rx, int d, int * my, int * mrx) {
+	erow * row = &F->row[cy];
+	for (int j = rx - 1; j >= 0; j--) {
+		d -= editorIsBracket(row, j);
+		if (d == 0) {
+			*my = cy;
+			*mrx = j;
+			return 0;
+		}
+	}
+
+	struct editorBrackets * B = editorBracketIndex(F);
+	int first;
+	int leaf = editorBracketLeaf(B, cy, &first);
+	int r = cy - 1;
+	while (r >= first && F->row[r].brackets.net - F->row[r].brackets.low < d) d -= F->row[r--].brackets.net;
+	if (r < first) {
+		if (r < 0) return -1;
+		int end = first;
+		leaf = editorBracketBackward(B, 1, 0, B->cap - 1, leaf - 1, &d, &end);
+		if (leaf == -1) return -1;
+		r = end - 1;
+		while (r >= 0 && F->row[r].brackets.net - F->row[r].brackets.low < d) d -= F->row[r--].brackets.net;
+		if (r < 0) return -1;
+	}
+
+	row = &F->row[r];
+	for (int j = row->rsize - 1; j >= 0; j--) {
+		d -= editorIsBracket(row, j);
+		if (d == 0) {
+			*my = r;
+			*mrx = j;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* the bracket pairing with the one at render column rx of row cy; brackets
+ * of all kinds share one depth, so a pair of different kinds is no match */
+int editorMatchBracket(efile * F, int cy, int rx, int * my, int * mrx) {
+	if (F->pager || F->hex || F->source || cy >= F->numrows) return -1;
+	erow * row = &F->row[cy];
+	if (rx >= row->rsize) return -1;
+	int b = editorIsBracket(row, rx);
+	if (b == 0) return -1;
+	int ret = (b > 0) ? editorBracketScanForward(F, cy, rx, 1, my, mrx) : editorBracketScanBackward(F, cy, rx, 1, my, mrx);
+	if (ret == -1) return -1;
+
+	char * pairs = "()[]{}";
+	int i = strchr(pairs, row->render[rx]) - pairs;
+	return (F->row[*my].render[*mrx] == pairs[i ^ 1]) ? 0 : -1;
+}
+
+/* the opening bracket of the innermost block around render column rx */
+int editorEnclosingBracket(efile * F, int cy, int rx, int * oy, int * orx) {
+	if (F->pager || F->hex || F->source || F->numrows == 0) return -1;
+	if (cy >= F->numrows) {
+		cy = F->numrows - 1;
+		rx = F->row[cy].rsize;
+	}
+	if (rx > F->row[cy].rsize) rx = F->row[cy].rsize;
+	return editorBracketScanBackward(F, cy, rx, 1, oy, orx);
+}
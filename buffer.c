@@ -0,0 +1,847 @@
+#include "kilo.h"
+
+/*** row operations ***/
+
+void removeHighlight(efile * F) {
+	for (int i = 0; i < 2; i++) {
+		F->beginsel[i] = -1;
+		F->endsel[i] = -1;
+	}
+}
+
+void editorRenderRow(erow * row) {
+	int tabs;
+	int utf8 = editorScanChars(row->chars, row->size, &tabs);
+
+	free(row->render);
+	free(row->fields);
+	row->fields = NULL;
+	row->render = malloc(row->size + tabs*(KILO_TAB_STOP - 1) + 1);
+
+	int idx = 0;
+	if (tabs == 0) {
+		memcpy(row->render, row->chars, row->size);
+		idx = row->size;
+	} else {
+		for (int j = 0; j < row->size; j++) {
+			if (row->chars[j] == '\t') {
+				row->render[idx++] = ' ';
+				while (idx % KILO_TAB_STOP != 0) row->render[idx++] = ' ';
+			} else row->render[idx++] = row->chars[j];
+		}
+	}
+	row->render[idx] = '\0';
+	row->rsize = idx;
+	editorRowColumns(row, utf8);
+}
+
+/* the row's chars have changed; its identifiers enter the word index
+ * again, the caller took them out before changing them */
+void editorUpdateRow(efile * F, erow * row) {
+	editorRenderRow(row);
+	editorWordsEnter(F, row);
+	editorUpdateSyntax(F, row);
+}
+
+/* marks on rows at or after at follow them when rows come and go */
+void editorShiftMarks(efile * F, int at, int delta) {
+	for (int i = 0; i < F->nummarks; i++) {
+		if (F->marks[i].line >= at) F->marks[i].line += delta;
+	}
+}
+
+void editorInsertRow(efile * F, int at, char * s, size_t len) {
+	if (at < 0 || at > F->numrows) return;
+
+	F->row = realloc(F->row, sizeof(erow) * (F->numrows + 1));
+	memmove(&F->row[at + 1], &F->row[at], sizeof(erow) * (F->numrows - at));
+	for (int j = at + 1; j <= F->numrows; j++) F->row[j].idx++;
+
+	F->row[at].idx = at;
+	F->row[at].snap = F->snapgen;
+
+	F->row[at].size = len;
+	F->row[at].chars = malloc(len + 1);
+	memcpy(F->row[at].chars, s, len);
+	F->row[at].chars[len] = '\0';
+
+	F->row[at].rsize = 0;
+	F->row[at].render = NULL;
+	F->row[at].rcol = NULL;
+	F->row[at].fields = NULL;
+	F->row[at].hl = NULL;
+	F->row[at].hl_open_comment = 0;
+	F->row[at].brackets.net = F->row[at].brackets.low = 0;
+	editorBracketInsert(F, at);
+	editorWordsInsert(F, at);
+	editorUpdateRow(F, &F->row[at]);
+	editorShiftMarks(F, at, 1);
+	editorShiftFolds(F, at, 1);
+
+	F->numrows++;
+	F->dirty++;
+}
+
+void editorFreeRow(erow * row) {
+	free(row->render);
+	free(row->rcol);
+	free(row->fields);
+	free(row->chars);
+	free(row->hl);
+}
+
+void editorDelRow(efile * F, int at) {
+	if (at < 0 || at >= F->numrows) return;
+	editorWordsDelete(F, &F->row[at]);
+	editorRowRelease(F, &F->row[at]);
+	editorFreeRow(&F->row[at]);
+	memmove(&F->row[at], &F->row[at + 1], sizeof(erow) * (F->numrows - at - 1));
+	for (int j = at; j < F->numrows - 1; j++) F->row[j].idx--;	
+	editorShiftMarks(F, at + 1, -1);
+	editorShiftFolds(F, at, -1);
+	editorBracketDelete(F, at);
+
+	F->numrows--;
+	F->dirty++;
+	if (F->beginsel[0] != -1) removeHighlight(F);
+}
+
+void editorRowInsertChar(efile * F, erow * row, int at, int c) {
+	if (at < 0 || at > row->size) at = row->size;
+	editorRowOwn(F, row);
+	editorWordsLeave(F, row);
+	row->chars = realloc(row->chars, row->size + 2);
+	memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+	row->size++;
+	row->chars[at] = c;
+	editorUpdateRow(F, row);
+	F->dirty++;
+	if (F->beginsel[0] != -1) removeHighlight(F);
+}
+
+void editorRowAppendString(efile * F, erow * row, char * s, size_t len) {
+	editorRowOwn(F, row);
+	editorWordsLeave(F, row);
+	row->chars = realloc(row->chars, row->size + len + 1);
+	memcpy(&row->chars[row->size], s, len);
+	row->size += len;
+	row->chars[row->size] = '\0';
+	editorUpdateRow(F, row);
+	F->dirty++;
+	if (F->beginsel[0] != -1) removeHighlight(F);
+}
+
+void editorRowDelChar(efile * F, erow * row, int at) {
+	if (at < 0 || at > row->size) return;
+	editorRowOwn(F, row);
+	editorWordsLeave(F, row);
+	memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
+	row->size--;
+	editorUpdateRow(F, row);
+	F->dirty++;
+	if (F->beginsel[0] != -1) removeHighlight(F);
+}
+
+/*** editor operations ***/
+
+void editorInsertChar(efile * F, int c) {
+	if (F->cy == F->numrows) {
+		editorInsertRow(F, F->numrows, "", 0);
+	}
+	editorRowInsertChar(F, &F->row[F->cy], F->cx, c);
+	F->cx++;
+}
+
+void editorInsertNewline(efile * F) {
+	int indent = 0;
+	if (F->cx == 0) {
+		editorInsertRow(F, F->cy, "", 0);
+	} else {
+		erow * row = &F->row[F->cy];
+		editorInsertRow(F, F->cy + 1, &row->chars[F->cx], row->size - F->cx);
+		row = &F->row[F->cy];
+		editorRowOwn(F, row);
+		editorWordsLeave(F, row);
+		row->size = F->cx;
+		row->chars[row->size] = '\0';
+		while (row->chars[indent] == ' ' || row->chars[indent] == '\t') {
+			editorRowInsertChar(F, &F->row[F->cy + 1], indent, row->chars[indent]);
+			indent++;
+		}
+		editorUpdateRow(F, row);
+	}
+	F->cy++;
+	F->cx = indent;
+}
+
+/* the selection as NUL-terminated strings, one per row */
+char ** editorCopyRows(efile * F, int * numrows) {
+	if (F->beginsel[0] == -1) return NULL;
+
+	int n = F->endsel[0] - F->beginsel[0] + 1;
+	char ** rows = malloc(sizeof(char *) * (n + 1));
+	for (int i = 0; i < n; i++) {
+		int colbegin = (i == 0) ? F->beginsel[1] : 0;
+		erow * row = editorFileRow(F, F->beginsel[0] + i);
+		int colend = (i == n - 1) ? F->endsel[1] : row->size;
+		rows[i] = malloc(sizeof(char) * (colend - colbegin + 1));
+		memcpy(rows[i], &row->chars[colbegin], colend - colbegin);
+		rows[i][colend - colbegin] = '\0';
+	}
+	rows[n] = NULL;
+	*numrows = n;
+	return rows;
+}
+
+void editorPasteRows(efile * F, char ** rows, int numrows) {
+	if (rows == NULL) return;
+
+	char * row = rows[0];
+	int pos = -1;
+	while (row[++pos] != '\0') {
+		editorInsertChar(F, row[pos]);
+	}
+	for (int i = 1; i < numrows; i++) {
+		row = rows[i];
+		int len = -1;
+		while (row[++len] != '\0');
+		editorInsertRow(F, ++F->cy, row, len);
+	}
+	F->cx = 0;
+}
+
+void editorDuplicateRow(efile * F) {
+	if (F->cy == F->numrows) return;
+	erow * row = &F->row[F->cy];
+	editorInsertRow(F, F->cy + 1, row->chars, row->size);
+	F->cy++;
+}
+
+void editorDeleteRow(efile * F) {
+	if (F->cy == F->numrows) return;
+	editorDelRow(F, F->cy);
+	F->cx = 0;
+}
+
+void editorDelChar(efile * F) {
+	if (F->cy == F->numrows) return;
+	if (F->cx == 0 && F->cy == 0) return;
+
+	erow * row = &F->row[F->cy];
+	if (F->cx > 0) {
+		/* the whole character, with any marks on it */
+		int prev = editorRowPrevCx(row, F->cx);
+		while (F->cx > prev) editorRowDelChar(F, row, --F->cx);
+	} else {
+		F->cx = F->row[F->cy - 1].size;
+		editorRowAppendString(F, &F->row[F->cy - 1], row->chars, row->size);
+		editorDelRow(F, F->cy);
+		F->cy--;
+	}
+}
+
+/*** cursor ***/
+
+erow editorEmptyRow = { 0, 0, 0, 0, "", "", NULL, NULL, NULL, 0, {0, 0} };
+
+/* rows of a pager are materialized on demand and a grep view borrows the
+ * rows of its source, everything else indexes F->row */
+erow * editorFileRow(efile * F, int at) {
+	if (F->pager) return editorPagerRow(F, at);
+	if (F->source) {
+		/* the source may have lost rows since the view was built */
+		int line = F->refs[at];
+		return (line < F->source->numrows) ? editorFileRow(F->source, line) : &editorEmptyRow;
+	}
+	return &F->row[at];
+}
+
+void editorMoveCursor(efile * F, int key) {
+	if (F->hex) {
+		editorHexMoveCursor(F, key);
+		return;
+	}
+	erow * row = (F->cy >= F->numrows) ? NULL : editorFileRow(F, F->cy);
+	int opos[2] = {F->cy, F->cx};
+
+	/* moving */
+	switch (key) {
+		case ARROW_LEFT:
+		case SHIFT_ARROW_LEFT:
+			if (F->cx != 0) F->cx = editorRowPrevCx(row, F->cx);
+			else if (F->cy > 0) {
+				F->cy = editorFoldRow(F, editorFoldVisible(F, F->cy) - 1);
+				F->cx = editorFileRow(F, F->cy)->size;
+			}
+			break;
+			
+		case ARROW_RIGHT:
+		case SHIFT_ARROW_RIGHT:
+			if (row && F->cx < row->size) F->cx = editorRowNextCx(row, F->cx);
+			else if (row && F->cx == row->size) {
+				F->cy = editorFoldRow(F, editorFoldVisible(F, F->cy) + 1);
+				F->cx = 0;
+			}
+			break;
+			
+		case ARROW_UP:
+		case SHIFT_ARROW_UP:
+			/* folded rows are stepped over */
+			if (F->cy != 0) F->cy = editorFoldRow(F, editorFoldVisible(F, F->cy) - 1);
+			break;
+			
+		case ARROW_DOWN:
+		case SHIFT_ARROW_DOWN:
+			if (F->cy < F->numrows) F->cy = editorFoldRow(F, editorFoldVisible(F, F->cy) + 1);
+			break;
+			
+		case HOME_KEY:
+			F->cx = 0;
+			break;
+			
+		case END_KEY:
+			if (F->cy < F->numrows) F->cx = editorFileRow(F, F->cy)->size;
+			break;
+	}
+	
+	int npos[2] = {F->cy, F->cx};
+	
+	if (SHIFT_KEY(key)) {
+		if (F->beginsel[0] == -1) {
+			for (int i = 0; i < 2; i++) {
+				F->beginsel[i] = (key == SHIFT_ARROW_LEFT) ? npos[i] : opos[i];
+				F->endsel[i] = (key == SHIFT_ARROW_LEFT) ? opos[i] : npos[i];
+			}
+		} else if (opos[0] == F->beginsel[0] && opos[1] == F->beginsel[1]) {
+			F->beginsel[0] = (npos[0] <= F->endsel[0]) ? npos[0] : F->beginsel[0];
+			F->beginsel[1] = (npos[0] < F->endsel[0] || npos[1] < F->endsel[1]) ? npos[1] : F->beginsel[1];
+		} else if (opos[0] == F->endsel[0] && opos[1] == F->endsel[1]) {
+			F->endsel[0] = (npos[0] >= F->beginsel[0]) ? npos[0] : F->endsel[0];
+			F->endsel[1] = (npos[0] > F->beginsel[0] || npos[1] > F->beginsel[1]) ? npos[1] : F->endsel[1];
+		}
+		//editorSetStatusMessage("(%d, %d) -> (%d, %d)", F->beginsel[0], F->beginsel[1], F->endsel[0], F->endsel[1]);
+	} else removeHighlight(F);
+	
+	row = (F->cy >= F->numrows) ? NULL : editorFileRow(F, F->cy);
+	int rowlen = row ? row->size : 0;
+	if (F->cx > rowlen) F->cx = rowlen;
+	/* a cursor carried to another row lands on a character boundary */
+	if (row) F->cx = editorRowClusterCx(row, F->cx);
+}
+
+/* jump straight to a position, clamped to the buffer */
+void editorSetCursor(efile * F, int cy, int cx) {
+	if (F->hex) {
+		editorHexSetCursor(F, cy, cx);
+		return;
+	}
+	if (cy > F->numrows) cy = F->numrows;
+	if (cy < 0) cy = 0;
+	removeHighlight(F);
+	/* a folded row lands on the row its fold shows */
+	F->cy = editorFoldRow(F, editorFoldVisible(F, cy));
+	erow * row = (F->cy >= F->numrows) ? NULL : editorFileRow(F, F->cy);
+	int rowlen = row ? row->size : 0;
+	F->cx = (cx > rowlen) ? rowlen : (cx < 0 ? 0 : cx);
+	if (row) F->cx = editorRowClusterCx(row, F->cx);
+}
+
+/*** marks ***/
+
+void editorSetMark(efile * F, char * name, int line) {
+	for (int i = 0; i < F->nummarks; i++) {
+		if (!strcmp(F->marks[i].name, name)) {
+			F->marks[i].line = line;
+			return;
+		}
+	}
+	F->marks = realloc(F->marks, sizeof(struct editorMark) * (F->nummarks + 1));
+	F->marks[F->nummarks].name = strdup(name);
+	F->marks[F->nummarks].line = line;
+	F->nummarks++;
+}
+
+/* line of the named mark, -1 if there is none */
+int editorGetMark(efile * F, char * name) {
+	for (int i = 0; i < F->nummarks; i++) {
+		if (!strcmp(F->marks[i].name, name)) return F->marks[i].line;
+	}
+	return -1;
+}
+
+/*** file loading ***/
+
+long editorMonotonicMs() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int editorLoadPublish(struct editorLoader * L, erow * rows, int numrows, off_t loaded) {
+	erowBatch * batch = NULL;
+	if (numrows > 0) {
+		batch = malloc(sizeof(erowBatch));
+		batch->rows = rows;
+		batch->numrows = numrows;
+		batch->next = NULL;
+	}
+
+	pthread_mutex_lock(&L->lock);
+	if (batch) {
+		if (L->tail) L->tail->next = batch;
+		else L->head = batch;
+		L->tail = batch;
+	}
+	L->loaded = loaded;
+	int cancel = L->cancel;
+	pthread_cond_signal(&L->cond);
+	pthread_mutex_unlock(&L->lock);
+	editorLoopWake();
+	return cancel;
+}
+
+void editorLoadRow(erow * row, char * s, size_t len) {
+	while (len > 0 && s[len - 1] == '\r') len--;
+	row->size = len;
+	row->snap = 0;
+	row->chars = malloc(len + 1);
+	memcpy(row->chars, s, len);
+	row->chars[len] = '\0';
+	row->rsize = 0;
+	row->render = NULL;
+	row->rcol = NULL;
+	row->fields = NULL;
+	row->hl = NULL;
+	row->hl_open_comment = 0;
+	row->brackets.net = row->brackets.low = 0;
+	editorRenderRow(row);
+}
+
+void * editorLoadThread(void * arg) {
+	struct editorLoader * L = arg;
+	char * buf = malloc(KILO_LOAD_CHUNK);
+	char * line = NULL;
+	size_t linelen = 0;
+	size_t linecap = 0;
+	off_t loaded = 0;
+
+	int batchsize = L->batch;
+	erow * rows = malloc(sizeof(erow) * batchsize);
+	int numrows = 0;
+	int cancel = 0;
+
+	while (!cancel) {
+		ssize_t nread = L->codec ? editorCodecRead(L->codec, buf, KILO_LOAD_CHUNK) : read(L->fd, buf, KILO_LOAD_CHUNK);
+		if (nread == -1 && errno == EINTR) continue;
+		if (nread == -1) L->error = errno;
+		if (nread <= 0) break;
+		loaded += nread;
+		/* progress of a compressed file is measured in the bytes taken from disk */
+		off_t consumed = L->codec ? editorCodecConsumed(L->codec) : 0;
+
+		char * p = buf;
+		char * end = buf + nread;
+		while (p < end && !cancel) {
+			char * nl = memchr(p, '\n', end - p);
+			size_t len = (nl ? nl : end) - p;
+			if (nl && linelen == 0) {
+				editorLoadRow(&rows[numrows++], p, len);
+			} else {
+				if (linelen + len > linecap) {
+					linecap = (linelen + len) * 2;
+					line = realloc(line, linecap);
+				}
+				memcpy(&line[linelen], p, len);
+				linelen += len;
+				if (nl) {
+					editorLoadRow(&rows[numrows++], line, linelen);
+					linelen = 0;
+				}
+			}
+			p += len + (nl ? 1 : 0);
+
+			if (numrows == batchsize) {
+				cancel = editorLoadPublish(L, rows, numrows, L->codec ? consumed : loaded - (end - p));
+				batchsize = KILO_LOAD_BATCH;
+				rows = malloc(sizeof(erow) * batchsize);
+				numrows = 0;
+			}
+		}
+	}
+	if (!cancel && !L->error && linelen > 0) editorLoadRow(&rows[numrows++], line, linelen);
+	L->unterminated = (linelen > 0);
+	if (numrows > 0 && !cancel) {
+		editorLoadPublish(L, rows, numrows, loaded);
+	} else {
+		for (int i = 0; i < numrows; i++) editorFreeRow(&rows[i]);
+		free(rows);
+	}
+
+	free(line);
+	free(buf);
+	pthread_mutex_lock(&L->lock);
+	L->loaded = L->codec ? editorCodecConsumed(L->codec) : loaded;
+	L->done = 1;
+	pthread_cond_signal(&L->cond);
+	pthread_mutex_unlock(&L->lock);
+	editorLoopWake();
+	return NULL;
+}
+
+/* rows are read on a worker thread, the first batch is sized to fill a screen;
+ * files in F->codec are decompressed on the way. -1 if the thread could not
+ * be started, -2 if the decompressor could not be set up */
+int editorLoadStart(efile * F, int fd, int batch) {
+	struct editorLoader * L = malloc(sizeof(struct editorLoader));
+	struct stat st;
+	L->codec = NULL;
+	if (F->codec != CODEC_NONE && (L->codec = editorCodecOpen(F->codec, fd)) == NULL) {
+		free(L);
+		return -2;
+	}
+	L->fd = fd;
+	L->size = (fstat(fd, &st) == 0) ? st.st_size : 0;
+	L->loaded = 0;
+	L->batch = (batch > 0) ? batch : KILO_LOAD_BATCH;
+	L->done = 0;
+	L->cancel = 0;
+	L->error = 0;
+	L->unterminated = 0;
+	L->head = NULL;
+	L->tail = NULL;
+	pthread_mutex_init(&L->lock, NULL);
+	pthread_cond_init(&L->cond, NULL);
+	if (pthread_create(&L->thread, NULL, editorLoadThread, L) != 0) {
+		pthread_mutex_destroy(&L->lock);
+		pthread_cond_destroy(&L->cond);
+		if (L->codec) editorCodecClose(L->codec);
+		free(L);
+		return -1;
+	}
+	F->loader = L;
+	return 0;
+}
+
+void editorLoadFree(efile * F) {
+	struct editorLoader * L = F->loader;
+	pthread_join(L->thread, NULL);
+	while (L->head) {
+		erowBatch * batch = L->head;
+		L->head = batch->next;
+		for (int i = 0; i < batch->numrows; i++) editorFreeRow(&batch->rows[i]);
+		free(batch->rows);
+		free(batch);
+	}
+	if (L->codec) editorCodecClose(L->codec);
+	close(L->fd);
+	pthread_mutex_destroy(&L->lock);
+	pthread_cond_destroy(&L->cond);
+	free(L);
+	F->loader = NULL;
+}
+
+void editorLoadCancel(efile * F) {
+	struct editorLoader * L = F->loader;
+	pthread_mutex_lock(&L->lock);
+	L->cancel = 1;
+	pthread_mutex_unlock(&L->lock);
+	editorLoadFree(F);
+	F->partial = 1;
+}
+
+/* appended rows belong to the buffer, not to a running save; one that
+ * doesn't have them leaves the buffer changed from what it writes */
+void editorAppendRows(efile * F, erow * rows, int numrows) {
+	F->row = realloc(F->row, sizeof(erow) * (F->numrows + numrows));
+	memcpy(&F->row[F->numrows], rows, sizeof(erow) * numrows);
+	for (int j = 0; j < numrows; j++) {
+		F->row[F->numrows + j].idx = F->numrows + j;
+		F->row[F->numrows + j].snap = F->snapgen;
+	}
+	F->numrows += numrows;
+	if (F->saver) F->dirty++;
+	editorHighlightRows(F, F->numrows - numrows, F->numrows);
+}
+
+int editorLoadDrain(efile * F, long budget) {
+	struct editorLoader * L = F->loader;
+	long start = editorMonotonicMs();
+	int drained = 0;
+
+	while (1) {
+		pthread_mutex_lock(&L->lock);
+		erowBatch * batch = L->head;
+		if (batch) {
+			L->head = batch->next;
+			if (L->head == NULL) L->tail = NULL;
+		}
+		int done = L->done;
+		pthread_mutex_unlock(&L->lock);
+
+		if (batch == NULL) {
+			if (done) {
+				F->error = L->error;
+				if (F->error) F->partial = 1;
+				F->size = L->loaded;
+				F->unterminated = L->unterminated;
+				editorLoadFree(F);
+				drained++;
+			}
+			break;
+		}
+
+		editorAppendRows(F, batch->rows, batch->numrows);
+		free(batch->rows);
+		free(batch);
+		drained++;
+		if (editorMonotonicMs() - start >= budget) break;
+	}
+	return drained;
+}
+
+void editorLoadWait(efile * F) {
+	struct editorLoader * L = F->loader;
+	pthread_mutex_lock(&L->lock);
+	while (L->head == NULL && !L->done) pthread_cond_wait(&L->cond, &L->lock);
+	pthread_mutex_unlock(&L->lock);
+	editorLoadDrain(F, KILO_LOAD_BUDGET);
+}
+
+int editorLoadProgress(efile * F) {
+	struct editorLoader * L = F->loader;
+	pthread_mutex_lock(&L->lock);
+	int percent = (L->size > 0) ? (int) (L->loaded * 100 / L->size) : 100;
+	pthread_mutex_unlock(&L->lock);
+	return percent;
+}
+
+/*** follow ***/
+
+/* watch the file for appends, new bytes are read from F->size on */
+int editorFollowStart(efile * F, int inotifyfd) {
+	if (F->filename == NULL || F->loader || F->follow || F->pager || F->hex || F->codec || F->source) return -1;
+	int fd = open(F->filename, O_RDONLY);
+	if (fd == -1) return -1;
+	int wd = inotify_add_watch(inotifyfd, F->filename, IN_MODIFY);
+	if (wd == -1) {
+		close(fd);
+		return -1;
+	}
+
+	struct editorFollow * W = malloc(sizeof(struct editorFollow));
+	W->fd = fd;
+	W->wd = wd;
+	W->inotify = inotifyfd;
+	W->more = 0;
+	F->follow = W;
+	return wd;
+}
+
+void editorFollowStop(efile * F) {
+	struct editorFollow * W = F->follow;
+	inotify_rm_watch(W->inotify, W->wd);
+	close(W->fd);
+	free(W);
+	F->follow = NULL;
+}
+
+int editorFollowAppend(efile * F, char * p, char * end) {
+	/* the tail of an unterminated last line is joined onto it */
+	if (F->unterminated && F->numrows > 0) {
+		char * nl = memchr(p, '\n', end - p);
+		size_t len = (nl ? nl : end) - p;
+		erow * row = &F->row[F->numrows - 1];
+		editorRowOwn(F, row);
+		editorWordsLeave(F, row);
+		row->chars = realloc(row->chars, row->size + len + 1);
+		memcpy(&row->chars[row->size], p, len);
+		row->size += len;
+		while (nl && row->size > 0 && row->chars[row->size - 1] == '\r') row->size--;
+		row->chars[row->size] = '\0';
+		editorUpdateRow(F, row);
+		if (F->saver) F->dirty++;
+		F->unterminated = (nl == NULL);
+		p += len + (nl ? 1 : 0);
+	}
+
+	erow * rows = NULL;
+	int numrows = 0;
+	int cap = 0;
+	while (p < end) {
+		char * nl = memchr(p, '\n', end - p);
+		size_t len = (nl ? nl : end) - p;
+		if (numrows == cap) {
+			cap = cap ? cap * 2 : 256;
+			rows = realloc(rows, sizeof(erow) * cap);
+		}
+		editorLoadRow(&rows[numrows++], p, len);
+		F->unterminated = (nl == NULL);
+		p += len + (nl ? 1 : 0);
+	}
+	if (numrows > 0) editorAppendRows(F, rows, numrows);
+	free(rows);
+	return numrows;
+}
+
+/* a file cut shorter than what was read, as a log rotated by truncating
+ * it, is read again from the start into an emptied buffer */
+void editorFollowTruncate(efile * F) {
+	if (F->wordrows > 0) {
+		editorWordsForget(F);
+		F->wordrows = 0;
+	}
+	for (int i = 0; i < F->numrows; i++) {
+		editorRowRelease(F, &F->row[i]);
+		editorFreeRow(&F->row[i]);
+	}
+	F->numrows = 0;
+	F->numfolds = 0;
+	editorBracketFree(F);
+	removeHighlight(F);
+	F->cy = F->cx = 0;
+	F->rowoff = 0;
+	F->size = 0;
+	F->unterminated = 0;
+	if (F->saver) F->dirty++;
+}
+
+/* append what was written since the last call, for at most budget ms */
+int editorFollowRead(efile * F, long budget) {
+	struct editorFollow * W = F->follow;
+	long start = editorMonotonicMs();
+	struct stat st;
+	if (fstat(W->fd, &st) == 0 && st.st_size < F->size) editorFollowTruncate(F);
+
+	char * buf = malloc(KILO_LOAD_CHUNK);
+	int added = 0;
+	W->more = 0;
+	while (1) {
+		ssize_t nread = pread(W->fd, buf, KILO_LOAD_CHUNK, F->size);
+		if (nread == -1 && errno == EINTR) continue;
+		if (nread <= 0) break;
+		F->size += nread;
+		added += editorFollowAppend(F, buf, buf + nread);
+		if (editorMonotonicMs() - start >= budget) {
+			W->more = 1;
+			break;
+		}
+	}
+	free(buf);
+	return added;
+}
+
+/*** files ***/
+
+efile * editorCreateFile() {
+	efile * F = malloc(sizeof(efile));
+	F->index = -1;
+	F->next = F->prev = -1;
+	F->lrunext = F->lruprev = -1;
+	F->cx = 0;
+	F->cy = 0;
+	F->rx = 0;
+	F->rowoff = 0;
+	F->coloff = 0;
+	F->numrows = 0;
+	F->row = NULL;
+	F->dirty = 0;
+	F->partial = 0;
+	F->error = 0;
+	F->size = 0;
+	F->unterminated = 0;
+	F->codec = CODEC_NONE;
+	F->resident = 1;
+	F->saving = 0;
+	F->saver = NULL;
+	F->snapgen = 0;
+	F->filename = NULL;
+	F->syntax = NULL;
+	F->loader = NULL;
+	F->follow = NULL;
+	F->pager = NULL;
+	F->hex = NULL;
+	F->columns = NULL;
+	F->marks = NULL;
+	F->nummarks = 0;
+	F->folds = NULL;
+	F->numfolds = 0;
+	F->brackets = NULL;
+	F->wordrows = -1;
+	F->source = NULL;
+	F->refs = NULL;
+
+	for (int i = 0; i < 2; i++) {
+		F->beginsel[i] = -1;
+		F->endsel[i] = -1;
+	}
+	return F;
+}
+
+void editorDestroyFile(efile * F) {
+	if (F->saver) {
+		off_t written;
+		editorSaveFinish(F, &written);
+	}
+	if (F->loader) editorLoadCancel(F);
+	if (F->follow) editorFollowStop(F);
+	if (F->pager) editorPagerClose(F);
+	if (F->hex) editorHexClose(F);
+	if (F->source) F->numrows = 0;
+	if (F->wordrows > 0) editorWordsForget(F);
+	for (int i = 0; i < F->numrows; i++) editorFreeRow(&F->row[i]);
+	free(F->row);
+	free(F->refs);
+	for (int i = 0; i < F->nummarks; i++) free(F->marks[i].name);
+	free(F->marks);
+	free(F->folds);
+	editorBracketFree(F);
+	editorColumnsStop(F);
+	free(F->filename);
+	free(F);
+}
+
+void editorRenderChunk(void * arg, int j) {
+	hlChunk * C = &((hlChunk *) arg)[j];
+	for (int i = C->start; i < C->end; i++) editorRenderRow(&C->file->row[i]);
+}
+
+/* rebuild the render and highlight state dropped by editorEvictRows */
+void editorRestoreRows(efile * F) {
+	if (F->pager || F->hex || F->source) {
+		F->resident = 1;
+		return;
+	}
+	int numchunks = F->numrows / KILO_HL_CHUNK_MIN + 1;
+	if (numchunks > editorPoolSize()) numchunks = editorPoolSize();
+	hlChunk * chunks = malloc(sizeof(hlChunk) * numchunks);
+	for (int c = 0; c < numchunks; c++) {
+		chunks[c].file = F;
+		chunks[c].start = (long) F->numrows * c / numchunks;
+		chunks[c].end = (long) F->numrows * (c + 1) / numchunks;
+	}
+	editorPoolRun(editorRenderChunk, chunks, numchunks);
+	free(chunks);
+	editorHighlightRows(F, 0, F->numrows);
+	F->resident = 1;
+}
+
+void editorEvictRows(efile * F) {
+	if (F->pager || F->hex || F->source) {
+		if (F->pager) editorPagerDrop(F);
+		F->resident = 0;
+		return;
+	}
+	for (int i = 0; i < F->numrows; i++) {
+		erow * row = &F->row[i];
+		free(row->render);
+		free(row->rcol);
+		free(row->fields);
+		free(row->hl);
+		row->render = NULL;
+		row->rcol = NULL;
+		row->fields = NULL;
+		row->hl = NULL;
+		row->rsize = 0;
+	}
+	F->resident = 0;
+}
@@ -0,0 +1,284 @@
+#include "kilo.h"
+
+#include <dlfcn.h>
+#include <zlib.h>
+
+/*** data ***/
+
+/* the few zstd entry points we use, resolved from libzstd at runtime so the
+ * editor builds and runs without it */
+typedef struct { const void * src; size_t size; size_t pos; } ZSTD_inBuffer;
+typedef struct { void * dst; size_t size; size_t pos; } ZSTD_outBuffer;
+
+struct editorZstd {
+	int loaded;
+	void * (* createDStream)(void);
+	size_t (* freeDStream)(void *);
+	size_t (* decompressStream)(void *, ZSTD_outBuffer *, ZSTD_inBuffer *);
+	void * (* createCStream)(void);
+	size_t (* freeCStream)(void *);
+	size_t (* initCStream)(void *, int);
+	size_t (* compressStream)(void *, ZSTD_outBuffer *, ZSTD_inBuffer *);
+	size_t (* endStream)(void *, ZSTD_outBuffer *);
+	unsigned (* isError)(size_t);
+};
+
+struct editorZstd Z = {0};
+pthread_mutex_t zstdinit = PTHREAD_MUTEX_INITIALIZER;
+
+struct editorCodec {
+	int type;
+	int fd;
+	char * in;
+	size_t inlen;
+	size_t inpos;
+	off_t consumed;
+	int eof;
+	int ended;
+	z_stream z;
+	void * zd;
+};
+
+struct editorCompressor {
+	int type;
+	int fd;
+	char * out;
+	off_t written;
+	z_stream z;
+	void * zc;
+};
+
+/*** zstd ***/
+
+int editorZstdLoad() {
+	pthread_mutex_lock(&zstdinit);
+	if (Z.loaded == 0) {
+		void * lib = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+		if (lib) {
+			*(void **) &Z.createDStream = dlsym(lib, "ZSTD_createDStream");
+			*(void **) &Z.freeDStream = dlsym(lib, "ZSTD_freeDStream");
+			*(void **) &Z.decompressStream = dlsym(lib, "ZSTD_decompressStream");
+			*(void **) &Z.createCStream = dlsym(lib, "ZSTD_createCStream");
+			*(void **) &Z.freeCStream = dlsym(lib, "ZSTD_freeCStream");
+			*(void **) &Z.initCStream = dlsym(lib, "ZSTD_initCStream");
+			*(void **) &Z.compressStream = dlsym(lib, "ZSTD_compressStream");
+			*(void **) &Z.endStream = dlsym(lib, "ZSTD_endStream");
+			*(void **) &Z.isError = dlsym(lib, "ZSTD_isError");
+		}
+		Z.loaded = (lib && Z.createDStream && Z.freeDStream && Z.decompressStream &&
+			Z.createCStream && Z.freeCStream && Z.initCStream && Z.compressStream &&
+			Z.endStream && Z.isError) ? 1 : -1;
+	}
+	pthread_mutex_unlock(&zstdinit);
+	return Z.loaded == 1 ? 0 : -1;
+}
+
+/*** codecs ***/
+
+/* compression format of fd from its magic bytes, the offset is left alone */
+int editorCodecDetect(int fd) {
+	unsigned char magic[4];
+	ssize_t n = pread(fd, magic, sizeof(magic), 0);
+	if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return CODEC_GZIP;
+	if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return CODEC_ZSTD;
+	return CODEC_NONE;
+}
+
+/* format a new file is written in, from its extension */
+int editorCodecFromName(char * filename) {
+	char * ext = filename ? strrchr(filename, '.') : NULL;
+	if (ext && !strcmp(ext, ".gz")) return CODEC_GZIP;
+	if (ext && !strcmp(ext, ".zst")) return CODEC_ZSTD;
+	return CODEC_NONE;
+}
+
+int editorCodecAvailable(int type) {
+	if (type == CODEC_ZSTD) return editorZstdLoad() == 0;
+	return 1;
+}
+
+char * editorCodecName(int type) {
+	switch (type) {
+		case CODEC_GZIP: return "gzip";
+		case CODEC_ZSTD: return "zstd";
+		default: return "none";
+	}
+}
+
+struct editorCodec * editorCodecOpen(int type, int fd) {
+	if (!editorCodecAvailable(type)) return NULL;
+	struct editorCodec * C = calloc(1, sizeof(struct editorCodec));
+	C->type = type;
+	C->fd = fd;
+	C->in = malloc(KILO_LOAD_CHUNK);
+	if (type == CODEC_GZIP) {
+		/* 32 on top of the window bits accepts the gzip header */
+		if (inflateInit2(&C->z, 15 + 32) != Z_OK) {
+			free(C->in);
+			free(C);
+			return NULL;
+		}
+	} else {
+		C->zd = Z.createDStream();
+		if (C->zd == NULL) {
+			free(C->in);
+			free(C);
+			return NULL;
+		}
+	}
+	return C;
+}
+
+void editorCodecClose(struct editorCodec * C) {
+	if (C->type == CODEC_GZIP) inflateEnd(&C->z);
+	else Z.freeDStream(C->zd);
+	free(C->in);
+	free(C);
+}
+
+/* compressed bytes taken from the file so far */
+off_t editorCodecConsumed(struct editorCodec * C) {
+	return C->consumed - (C->inlen - C->inpos);
+}
+
+/* decompressed bytes, 0 at the end of the stream and -1 with errno set on
+ * a read error or corrupt or truncated input */
+ssize_t editorCodecRead(struct editorCodec * C, char * buf, size_t len) {
+	while (1) {
+		if (C->inpos == C->inlen && !C->eof) {
+			ssize_t nread = read(C->fd, C->in, KILO_LOAD_CHUNK);
+			if (nread == -1 && errno == EINTR) continue;
+			if (nread == -1) return -1;
+			if (nread == 0) C->eof = 1;
+			C->inlen = nread;
+			C->inpos = 0;
+			C->consumed += nread;
+		}
+		if (C->inpos == C->inlen && C->eof) {
+			if (C->ended) return 0;
+			errno = EIO;
+			return -1;
+		}
+
+		size_t produced;
+		if (C->type == CODEC_GZIP) {
+			/* concatenated members, as written by appending gzip, continue the stream */
+			if (C->ended) inflateReset(&C->z);
+			C->z.next_in = (unsigned char *) C->in + C->inpos;
+			C->z.avail_in = C->inlen - C->inpos;
+			C->z.next_out = (unsigned char *) buf;
+			C->z.avail_out = len;
+			int ret = inflate(&C->z, Z_NO_FLUSH);
+			C->inpos = C->inlen - C->z.avail_in;
+			produced = len - C->z.avail_out;
+			if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+				errno = EIO;
+				return -1;
+			}
+			C->ended = (ret == Z_STREAM_END);
+		} else {
+			ZSTD_inBuffer in = { C->in, C->inlen, C->inpos };
+			ZSTD_outBuffer out = { buf, len, 0 };
+			size_t ret = Z.decompressStream(C->zd, &out, &in);
+			if (Z.isError(ret)) {
+				errno = EIO;
+				return -1;
+			}
+			C->inpos = in.pos;
+			produced = out.pos;
+			C->ended = (ret == 0);
+		}
+		if (produced > 0) return produced;
+	}
+}
+
+/*** compression ***/
+
+/* a stream compressed onto fd a chunk at a time as the file is saved */
+struct editorCompressor * editorCompressOpen(int type, int fd) {
+	if (!editorCodecAvailable(type)) return NULL;
+	struct editorCompressor * K = calloc(1, sizeof(struct editorCompressor));
+	K->type = type;
+	K->fd = fd;
+	K->out = malloc(KILO_LOAD_CHUNK);
+	if (type == CODEC_GZIP) {
+		/* 16 on top of the window bits writes a gzip header */
+		if (deflateInit2(&K->z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			free(K->out);
+			free(K);
+			return NULL;
+		}
+	} else {
+		K->zc = Z.createCStream();
+		if (K->zc == NULL || Z.isError(Z.initCStream(K->zc, 3))) {
+			if (K->zc) Z.freeCStream(K->zc);
+			free(K->out);
+			free(K);
+			return NULL;
+		}
+	}
+	return K;
+}
+
+void editorCompressClose(struct editorCompressor * K) {
+	if (K->type == CODEC_GZIP) deflateEnd(&K->z);
+	else Z.freeCStream(K->zc);
+	free(K->out);
+	free(K);
+}
+
+int editorCompressPut(struct editorCompressor * K, size_t len) {
+	char * p = K->out;
+	K->written += len;
+	while (len > 0) {
+		ssize_t n = write(K->fd, p, len);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1) return -1;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* compress len bytes of buf, or with finish the end of the stream; -1 with
+ * errno set if the codec or the write fails */
+int editorCompressRun(struct editorCompressor * K, char * buf, size_t len, int finish) {
+	if (K->type == CODEC_GZIP) {
+		K->z.next_in = (unsigned char *) buf;
+		K->z.avail_in = len;
+		int ret;
+		do {
+			K->z.next_out = (unsigned char *) K->out;
+			K->z.avail_out = KILO_LOAD_CHUNK;
+			ret = deflate(&K->z, finish ? Z_FINISH : Z_NO_FLUSH);
+			if (ret == Z_STREAM_ERROR || editorCompressPut(K, KILO_LOAD_CHUNK - K->z.avail_out) == -1) {
+				if (ret == Z_STREAM_ERROR) errno = EIO;
+				return -1;
+			}
+		} while (finish ? ret != Z_STREAM_END : K->z.avail_out == 0);
+		return 0;
+	}
+
+	ZSTD_inBuffer in = { buf, len, 0 };
+	size_t ret;
+	do {
+		ZSTD_outBuffer out = { K->out, KILO_LOAD_CHUNK, 0 };
+		ret = finish ? Z.endStream(K->zc, &out) : Z.compressStream(K->zc, &out, &in);
+		if (Z.isError(ret)) {
+			errno = EIO;
+			return -1;
+		}
+		if (editorCompressPut(K, out.pos) == -1) return -1;
+	} while (finish ? ret != 0 : in.pos < in.size);
+	return 0;
+}
+
+int editorCompressWrite(struct editorCompressor * K, char * buf, size_t len) {
+	return editorCompressRun(K, buf, len, 0);
+}
+
+/* compressed bytes written in all, or -1 if the end of the stream failed */
+off_t editorCompressFinish(struct editorCompressor * K) {
+	if (editorCompressRun(K, NULL, 0, 1) == -1) return -1;
+	return K->written;
+}
@@ -0,0 +1,193 @@
+#include "kilo.h"
+
+/*** data ***/
+
+/* the aligned view of a delimited file: how wide each column is drawn
+ * and where it starts, taken from a sample of rows rather than all of them */
+struct editorColumns {
+	int numcols;
+	int * width;
+	int * pos;
+	int sampled;
+	int partial;
+};
+
+/*** fields ***/
+
+int editorFieldSeparator(struct editorSyntax * syntax) {
+	if (syntax == NULL) return 0;
+	if (syntax->flags & HL_CSV) return ',';
+	if (syntax->flags & HL_TSV) return '\t';
+	return 0;
+}
+
+void editorFieldBegin(struct editorField * f) {
+	f->next = 0;
+	f->rnext = 0;
+	f->more = 1;
+}
+
+/* step f over the next field of row, 0 once the last one is done; a
+ * quoted field may hold the separator, with "" for a quote inside it */
+int editorNextField(erow * row, int sep, struct editorField * f) {
+	if (!f->more) return 0;
+	int c = f->next, ro = f->rnext;
+	int quoted = (c < row->size && row->chars[c] == '"');
+	int inquote = 0;
+	f->cs = c;
+	f->rs = ro;
+	for (; c < row->size; c++) {
+		char ch = row->chars[c];
+		if (quoted && ch == '"') inquote = !inquote;
+		else if (ch == sep && !inquote) break;
+		ro += (ch == '\t') ? KILO_TAB_STOP - ro % KILO_TAB_STOP : 1;
+	}
+	f->ce = c;
+	f->re = ro;
+	f->more = (c < row->size);
+	if (f->more) {
+		ro += (row->chars[c] == '\t') ? KILO_TAB_STOP - ro % KILO_TAB_STOP : 1;
+		c++;
+	}
+	f->next = c;
+	f->rnext = ro;
+	return 1;
+}
+
+/* render spans of the fields of row, as {n, start0, end0, start1, ...};
+ * built the first time the row is shown and dropped when it is rendered
+ * again, so a frame never splits a row it has split before */
+int * editorRowFields(erow * row, int sep) {
+	if (row->fields) return row->fields;
+	struct editorField f;
+	int n = 0;
+	editorFieldBegin(&f);
+	while (editorNextField(row, sep, &f)) n++;
+
+	int * fields = malloc(sizeof(int) * (1 + 2 * n));
+	fields[0] = n;
+	editorFieldBegin(&f);
+	for (int i = 0; editorNextField(row, sep, &f); i++) {
+		fields[1 + 2 * i] = f.rs;
+		fields[2 + 2 * i] = f.re;
+	}
+	row->fields = fields;
+	return fields;
+}
+
+/*** columns ***/
+
+void editorColumnsStart(efile * F) {
+	F->columns = calloc(1, sizeof(struct editorColumns));
+}
+
+void editorColumnsStop(efile * F) {
+	struct editorColumns * C = F->columns;
+	if (C == NULL) return;
+	free(C->width);
+	free(C->pos);
+	free(C);
+	F->columns = NULL;
+}
+
+/* widths are the 90th percentile of a sample of rows, so one long value
+ * does not stretch its column for everything else, and wide enough for
+ * the first row, which is usually a header. The sample is spread over the
+ * whole buffer, or for the pager taken from the screen on, where rows are
+ * built anyway; one taken while loading is taken again once done */
+void editorColumnsSample(efile * F, int from) {
+	struct editorColumns * C = F->columns;
+	int sep = editorFieldSeparator(F->syntax);
+	if (C == NULL || sep == 0) return;
+	if (C->sampled && !(C->partial && !F->loader)) return;
+
+	int * counts = calloc(KILO_COLUMN_MAX * (KILO_COLUMN_WIDTH + 1), sizeof(int));
+	int * rows = calloc(KILO_COLUMN_MAX, sizeof(int));
+	int * head = calloc(KILO_COLUMN_MAX, sizeof(int));
+	int numcols = 0;
+	if (F->numrows > 0) {
+		erow * row = editorFileRow(F, 0);
+		struct editorField f;
+		editorFieldBegin(&f);
+		for (int i = 0; i < KILO_COLUMN_MAX && editorNextField(row, sep, &f); i++) {
+			head[i] = editorRowRenderToRx(row, f.re) - editorRowRenderToRx(row, f.rs);
+		}
+	}
+	int numsample = (F->numrows < KILO_COLUMN_SAMPLE) ? F->numrows : KILO_COLUMN_SAMPLE;
+	if (F->pager) {
+		if (from + numsample > F->numrows) from = F->numrows - numsample;
+	}
+	for (int s = 0; s < numsample; s++) {
+		int at = F->pager ? from + s : (int) ((long) F->numrows * s / numsample);
+		erow * row = editorFileRow(F, at);
+		struct editorField f;
+		editorFieldBegin(&f);
+		for (int i = 0; i < KILO_COLUMN_MAX && editorNextField(row, sep, &f); i++) {
+			int width = editorRowRenderToRx(row, f.re) - editorRowRenderToRx(row, f.rs);
+			if (width > KILO_COLUMN_WIDTH) width = KILO_COLUMN_WIDTH;
+			counts[i * (KILO_COLUMN_WIDTH + 1) + width]++;
+			rows[i]++;
+			if (i >= numcols) numcols = i + 1;
+		}
+	}
+
+	C->width = realloc(C->width, sizeof(int) * (numcols ? numcols : 1));
+	C->pos = realloc(C->pos, sizeof(int) * (numcols ? numcols : 1));
+	int pos = 0;
+	for (int i = 0; i < numcols; i++) {
+		int seen = 0, width = 0;
+		int enough = (rows[i] * 9 + 5) / 10;
+		while (width < KILO_COLUMN_WIDTH) {
+			seen += counts[i * (KILO_COLUMN_WIDTH + 1) + width];
+			if (seen >= enough) break;
+			width++;
+		}
+		if (width < head[i]) width = (head[i] < KILO_COLUMN_WIDTH) ? head[i] : KILO_COLUMN_WIDTH;
+		C->width[i] = width ? width : 1;
+		C->pos[i] = pos;
+		pos += C->width[i] + KILO_COLUMN_GAP;
+	}
+	C->numcols = numcols;
+	C->sampled = 1;
+	C->partial = (F->loader != NULL);
+	free(counts);
+	free(rows);
+	free(head);
+}
+
+/* screen column field i of a row starts at, given where the field before
+ * it ended; a field wider than its column pushes the rest of its row along */
+int editorColumnStart(efile * F, int i, int prevend) {
+	struct editorColumns * C = F->columns;
+	if (i == 0) return 0;
+	int x = prevend + KILO_COLUMN_GAP;
+	if (i < C->numcols && C->pos[i] > x) x = C->pos[i];
+	return x;
+}
+
+/* screen column of render offset ro in the aligned view; a separator sits
+ * on the rule drawn before the field after it */
+int editorColumnsRx(efile * F, erow * row, int ro) {
+	int * fields = editorRowFields(row, editorFieldSeparator(F->syntax));
+	int prevend = 0;
+	for (int i = 0; i < fields[0]; i++) {
+		int rs = fields[1 + 2 * i], re = fields[2 + 2 * i];
+		int x = editorColumnStart(F, i, prevend);
+		if (ro < rs) return x - KILO_COLUMN_GAP + 1;
+		if (ro < re || i == fields[0] - 1) {
+			if (ro > re) ro = re;
+			return x + editorRowRenderToRx(row, ro) - editorRowRenderToRx(row, rs);
+		}
+		prevend = x + editorRowRenderToRx(row, re) - editorRowRenderToRx(row, rs);
+	}
+	return 0;
+}
+
+/* the field render offset ro falls in, a separator counting with the
+ * field before it */
+int editorColumnsField(efile * F, erow * row, int ro) {
+	int * fields = editorRowFields(row, editorFieldSeparator(F->syntax));
+	int i = 0;
+	while (i + 1 < fields[0] && ro >= fields[3 + 2 * i]) i++;
+	return i;
+}
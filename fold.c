@@ -0,0 +1,118 @@
+#include "kilo.h"
+
+/*** fold index ***/
+
+/* folds are kept sorted and disjoint, each knowing how many rows the folds
+ * before it hide, so file rows and screen rows map onto each other with a
+ * binary search however many rows are folded away */
+
+int editorFoldHidden(efile * F, int i) {
+	if (i == 0) return 0;
+	struct editorFold * f = &F->folds[i - 1];
+	return f->hidden + f->end - f->start;
+}
+
+void editorFoldCount(efile * F, int from) {
+	int hidden = editorFoldHidden(F, from);
+	for (int i = from; i < F->numfolds; i++) {
+		F->folds[i].hidden = hidden;
+		hidden += F->folds[i].end - F->folds[i].start;
+	}
+}
+
+/* folds that end above row */
+int editorFoldsBefore(efile * F, int row) {
+	int lo = 0, hi = F->numfolds;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (F->folds[mid].end < row) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+/* screen row of a file row, a hidden row shares the row of its fold */
+int editorFoldVisible(efile * F, int row) {
+	if (F->numfolds == 0) return row;
+	int i = editorFoldsBefore(F, row);
+	if (i < F->numfolds && F->folds[i].start < row) return F->folds[i].start - F->folds[i].hidden;
+	return row - editorFoldHidden(F, i);
+}
+
+/* file row shown on a screen row */
+int editorFoldRow(efile * F, int visible) {
+	if (F->numfolds == 0) return visible;
+	int lo = 0, hi = F->numfolds;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (F->folds[mid].start - F->folds[mid].hidden < visible) lo = mid + 1;
+		else hi = mid;
+	}
+	return visible + editorFoldHidden(F, lo);
+}
+
+int editorFoldRows(efile * F) {
+	return F->numrows - editorFoldHidden(F, F->numfolds);
+}
+
+/* rows folded under row, 0 when no fold starts there */
+int editorFoldAt(efile * F, int row) {
+	if (F->numfolds == 0) return 0;
+	int i = editorFoldsBefore(F, row);
+	if (i < F->numfolds && F->folds[i].start == row) return F->folds[i].end - F->folds[i].start;
+	return 0;
+}
+
+/*** folding ***/
+
+void editorFoldRemove(efile * F, int i) {
+	memmove(&F->folds[i], &F->folds[i + 1], sizeof(struct editorFold) * (F->numfolds - i - 1));
+	F->numfolds--;
+}
+
+/* folds already inside the range are taken into the new one */
+void editorFold(efile * F, int start, int end) {
+	if (end >= F->numrows) end = F->numrows - 1;
+	if (start < 0 || end <= start) return;
+	int i = editorFoldsBefore(F, start);
+	while (i < F->numfolds && F->folds[i].start <= end) {
+		if (F->folds[i].end > end) end = F->folds[i].end;
+		editorFoldRemove(F, i);
+	}
+	F->folds = realloc(F->folds, sizeof(struct editorFold) * (F->numfolds + 1));
+	memmove(&F->folds[i + 1], &F->folds[i], sizeof(struct editorFold) * (F->numfolds - i));
+	F->folds[i].start = start;
+	F->folds[i].end = end;
+	F->numfolds++;
+	editorFoldCount(F, i);
+}
+
+/* opens the fold starting on or hiding row, returns 0 if there is none */
+int editorUnfold(efile * F, int row) {
+	int i = editorFoldsBefore(F, row);
+	if (i == F->numfolds || F->folds[i].start > row) return 0;
+	editorFoldRemove(F, i);
+	editorFoldCount(F, i);
+	return 1;
+}
+
+void editorUnfoldAll(efile * F) {
+	free(F->folds);
+	F->folds = NULL;
+	F->numfolds = 0;
+}
+
+/* a row inserted at or deleted from at: folds below move with their rows,
+ * and a fold whose rows are edited opens */
+void editorShiftFolds(efile * F, int at, int delta) {
+	if (F->numfolds == 0) return;
+	int i = editorFoldsBefore(F, at);
+	if (i == F->numfolds) return;
+	struct editorFold * f = &F->folds[i];
+	if (f->start < at || (delta < 0 && f->start == at)) editorFoldRemove(F, i);
+	for (int j = i; j < F->numfolds; j++) {
+		F->folds[j].start += delta;
+		F->folds[j].end += delta;
+	}
+	editorFoldCount(F, i);
+}
@@ -0,0 +1,220 @@
+#include "kilo.h"
+
+#include <sys/mman.h>
+
+/*** data ***/
+
+/* a binary shown as rows of KILO_HEX_WIDTH bytes read straight from the
+ * mapping; no row is ever built, so memory stays flat whatever the size */
+struct editorHex {
+	int fd;
+	char * map;
+	off_t mapsize;
+	off_t size;
+	long pagesize;
+};
+
+/*** opening ***/
+
+/* text never holds a NUL byte, so one in the first block marks a binary */
+int editorIsBinary(int fd) {
+	char buf[KILO_HEX_SNIFF];
+	ssize_t n = pread(fd, buf, sizeof(buf), 0);
+	return n > 0 && memchr(buf, '\0', n) != NULL;
+}
+
+int editorHexOpen(efile * F, int fd) {
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) return -1;
+	if ((st.st_size - 1) / KILO_HEX_WIDTH >= INT_MAX) return -1;
+	char * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) return -1;
+
+	struct editorHex * H = malloc(sizeof(struct editorHex));
+	H->fd = fd;
+	H->map = map;
+	H->mapsize = st.st_size;
+	H->size = st.st_size;
+	H->pagesize = sysconf(_SC_PAGESIZE);
+	F->hex = H;
+	F->size = st.st_size;
+	F->numrows = (st.st_size + KILO_HEX_WIDTH - 1) / KILO_HEX_WIDTH;
+	editorMapGuard(map, st.st_size);
+	return 0;
+}
+
+void editorHexClose(efile * F) {
+	struct editorHex * H = F->hex;
+	editorMapUnguard(H->map);
+	munmap(H->map, H->mapsize);
+	close(H->fd);
+	free(H);
+	F->hex = NULL;
+	F->numrows = 0;
+}
+
+/*** rows ***/
+
+/* the bytes of row at, pointing into the mapping */
+unsigned char * editorHexRow(efile * F, int at, int * len) {
+	struct editorHex * H = F->hex;
+	off_t start = (off_t) at * KILO_HEX_WIDTH;
+	off_t left = H->size - start;
+	*len = (left < KILO_HEX_WIDTH) ? (int) left : KILO_HEX_WIDTH;
+	return (unsigned char *) H->map + start;
+}
+
+int editorHexRowSize(efile * F, int at) {
+	int len;
+	editorHexRow(F, at, &len);
+	return len;
+}
+
+/* a file truncated since it was mapped is shown up to its new end, the
+ * bytes past it can no longer be read */
+void editorHexCheck(efile * F) {
+	struct editorHex * H = F->hex;
+	off_t valid = editorMapValid(H->fd, H->size);
+	if (valid == H->size) return;
+	H->size = valid;
+	F->size = valid;
+	F->numrows = (valid + KILO_HEX_WIDTH - 1) / KILO_HEX_WIDTH;
+	editorHexSetCursor(F, F->cy, F->cx);
+}
+
+off_t editorHexOffset(efile * F) {
+	return (off_t) F->cy * KILO_HEX_WIDTH + F->cx;
+}
+
+/*** cursor ***/
+
+/* the cursor is always on a byte, there is no position past the last one */
+void editorHexSetCursor(efile * F, int cy, int cx) {
+	if (cy >= F->numrows) cy = F->numrows - 1;
+	if (cy < 0) cy = 0;
+	int len = editorHexRowSize(F, cy);
+	if (cx >= len) cx = len - 1;
+	if (cx < 0) cx = 0;
+	F->cy = cy;
+	F->cx = cx;
+}
+
+void editorHexMoveCursor(efile * F, int key) {
+	int cy = F->cy, cx = F->cx;
+	switch (key) {
+		case ARROW_LEFT:
+		case SHIFT_ARROW_LEFT:
+			if (cx > 0) cx--;
+			else if (cy > 0) {
+				cy--;
+				cx = KILO_HEX_WIDTH - 1;
+			}
+			break;
+		case ARROW_RIGHT:
+		case SHIFT_ARROW_RIGHT:
+			if (cx + 1 < editorHexRowSize(F, cy)) cx++;
+			else if (cy + 1 < F->numrows) {
+				cy++;
+				cx = 0;
+			}
+			break;
+		case ARROW_UP:
+		case SHIFT_ARROW_UP:
+			cy--;
+			break;
+		case ARROW_DOWN:
+		case SHIFT_ARROW_DOWN:
+			cy++;
+			break;
+		case HOME_KEY:
+			cx = 0;
+			break;
+		case END_KEY:
+			cx = KILO_HEX_WIDTH - 1;
+			break;
+	}
+	editorHexSetCursor(F, cy, cx);
+}
+
+/*** search ***/
+
+/* the bytes to look for: pairs of hex digits, with spaces between them
+ * ignored, or the text itself when it is anything else; -1 while an odd
+ * digit is still waiting for its pair */
+int editorHexPattern(char * query, char * out) {
+	int len = 0, digits = 0, hex = 1;
+	for (char * p = query; *p; p++) {
+		if (isxdigit((unsigned char) *p)) digits++;
+		else if (*p != ' ') hex = 0;
+	}
+	if (!hex || digits == 0) {
+		len = strlen(query);
+		memcpy(out, query, len);
+		return len;
+	}
+	if (digits % 2) return -1;
+	char pair[3] = {0};
+	int n = 0;
+	for (char * p = query; *p; p++) {
+		if (*p == ' ') continue;
+		pair[n++] = *p;
+		if (n == 2) {
+			out[len++] = (char) strtol(pair, NULL, 16);
+			n = 0;
+		}
+	}
+	return len;
+}
+
+/* searched pages are dropped from the resident set, reaching past both
+ * ends for the neighbours fault-around mapped with them */
+void editorHexRelease(struct editorHex * H, off_t start, off_t end) {
+	start = (start > KILO_PAGER_AROUND) ? (start - KILO_PAGER_AROUND) & ~(H->pagesize - 1) : 0;
+	end += KILO_PAGER_AROUND;
+	if (end > H->size) end = H->size;
+	end = (end + H->pagesize - 1) & ~(H->pagesize - 1);
+	if (end > start) madvise(H->map + start, end - start, MADV_DONTNEED);
+}
+
+/* first (last going backwards) match starting in [lo, hi), a chunk at a
+ * time; chunks overlap by len - 1 so no match is cut in two */
+off_t editorHexScan(struct editorHex * H, char * pat, int len, off_t lo, off_t hi, int direction) {
+	off_t chunk = KILO_PAGER_SCAN;
+	off_t at = -1;
+	for (off_t n = 0; n < hi - lo && at == -1; n += chunk) {
+		off_t start = (direction == 1) ? lo + n : hi - n - chunk;
+		if (start < lo) start = lo;
+		off_t stop = (direction == 1) ? start + chunk : hi - n;
+		if (stop > hi) stop = hi;
+		off_t end = stop + len - 1;
+		if (end > H->size) end = H->size;
+
+		char * p = H->map + start;
+		while ((p = memmem(p, H->map + end - p, pat, len)) != NULL && p - H->map < stop) {
+			at = p - H->map;
+			if (direction == 1) break;
+			p++;
+		}
+		editorHexRelease(H, start, end);
+	}
+	return at;
+}
+
+/* offset of the next match after from, or the one before it going
+ * backwards, wrapping around the file; -1 if there is none. Whatever it
+ * reads is released again, so a search over many gigabytes stays within
+ * a chunk of memory */
+off_t editorHexSearch(efile * F, char * pat, int len, off_t from, int direction) {
+	struct editorHex * H = F->hex;
+	editorHexCheck(F);
+	if (len <= 0 || len > H->size) return -1;
+	off_t at;
+	if (direction == 1) {
+		at = editorHexScan(H, pat, len, from + 1, H->size, 1);
+		if (at == -1) at = editorHexScan(H, pat, len, 0, from + 1, 1);
+	} else {
+		at = editorHexScan(H, pat, len, 0, from, -1);
+		if (at == -1) at = editorHexScan(H, pat, len, from, H->size, -1);
+	}
+	return at;
+}
@@ -1,3 +1,5 @@
+#include "kilo.h"
+
 /*** filetypes ***/
 
 /* C */
@@ -5,7 +7,7 @@ char * C_HL_extensions[] = { ".c", NULL };
 char * C_HL_keywords[] = {
 	"break", "case", "continue", "do", "default", "else", "enum", "extern", "for", "if", "goto", "NULL", "register", "return", "static", "sizeof",
 	"struct", "switch", "typedef", "union", "while", 
-	"auto|", "char|", "const|", "double|", "float|", "int|", "long|", "signed|", "short|", "void|", "volatile|", "unsigned|"
+	"auto|", "char|", "const|", "double|", "float|", "int|", "long|", "signed|", "short|", "void|", "volatile|", "unsigned|", NULL
 };
 
 char * CPP_HL_extensions[] = { ".h", ".cpp", NULL };
@@ -14,7 +16,7 @@ char * CPP_HL_keywords[] = {
 	"explicit", "false", "for", "friend", "if", "goto", "inline", "mutable", "namespace", "new", "NULL", "operator", "private", "protected",
 	"public",  "register", "reinterpret_cast", "return", "static", "static_cast", "sizeof",	"struct", "switch", "template", "this", "throw",
 	"true", "try", "typedef", "typeid", "typename", "union", "using","virtual",  "while", 
-	"auto|", "bool|", "char|", "const|", "double|", "float|", "int|", "long|", "signed|", "short|", "void|", "volatile|", "unsigned|", "wchar_t|"
+	"auto|", "bool|", "char|", "const|", "double|", "float|", "int|", "long|", "signed|", "short|", "void|", "volatile|", "unsigned|", "wchar_t|", NULL
 };
 
 /* Python */
@@ -23,7 +25,7 @@ char * PY_HL_keywords[] = {
 	"False", "None", "True", "and", "as", "assert", "async", "await", "break", "class", "continue", "def", "del", "elif", "else", "except",
 	"finally", "for", "from", "global", "if", "import", "in", "is", "lambda", "nonlocal", "not", "or", "pass", "raise",	"return", "try", "while",
 	"with", "yield",
-	"str|", "int|", "float|", "complex|", "list|", "tuple|", "range|", "dict|", "set|", "frozenset|", "bool|", "bytes|", "bytearray|", "memoryview|"
+	"str|", "int|", "float|", "complex|", "list|", "tuple|", "range|", "dict|", "set|", "frozenset|", "bool|", "bytes|", "bytearray|", "memoryview|", NULL
 };
 
 /* Javascript */
@@ -33,5 +35,57 @@ char * JS_HL_keywords[] = {
 	"export", "extends", "false", "final", "finally", "for", "function", "goto", "if", "implements", "import", "in", "instanceof", "interface",
 	"let", "native", "new", "null", "package", "private", "protected", "public", "return", "static", "super", "switch", "synchronized", "this",
 	"throw", "throws", "transient", "true", "try", "typeof", "var", "while", "with", "yield", 
-	"boolean|", "byte|", "char|", "const|", "double|", "float|", "int|", "long|", "short|", "void|", "volatile|", "var|"
+	"boolean|", "byte|", "char|", "const|", "double|", "float|", "int|", "long|", "short|", "void|", "volatile|", "var|", NULL
 };
+
+/* delimited data */
+char * CSV_HL_extensions[] = { ".csv", NULL };
+char * TSV_HL_extensions[] = { ".tsv", ".tab", NULL };
+char * NO_HL_keywords[] = { NULL };
+
+struct editorSyntax HLDB[] = {
+	{
+		"C",
+		C_HL_extensions,
+		C_HL_keywords,
+		"//", "/*", "*/",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS | HL_FOLD_BRACES
+	},
+	{
+		"C++",
+		CPP_HL_extensions,
+		CPP_HL_keywords,
+		"//", "/*", "*/",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS | HL_FOLD_BRACES
+	},
+	{
+		"Python",
+		PY_HL_extensions,
+		PY_HL_keywords,
+		"#", "'''", "'''",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
+	},
+	{
+		"JavaScript",
+		JS_HL_extensions,
+		JS_HL_keywords,
+		"//", "/*", "*/",
+		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS | HL_FOLD_BRACES
+	},
+	{
+		"CSV",
+		CSV_HL_extensions,
+		NO_HL_keywords,
+		NULL, NULL, NULL,
+		HL_CSV
+	},
+	{
+		"TSV",
+		TSV_HL_extensions,
+		NO_HL_keywords,
+		NULL, NULL, NULL,
+		HL_TSV
+	}
+};
+
+unsigned int HLDB_ENTRIES = sizeof(HLDB) / sizeof(HLDB[0]);
@@ -5,92 +5,59 @@
 /*** defines ***/
 
 #define KILO_VERSION "0.0.4"
-#define CTRL_KEY(k) ((k) & 0x1F)
-#define SHIFT_KEY(k) ((k) & 0x400)
 #define ABUF_INIT {NULL, 0}
-#define KILO_TAB_STOP 4
 #define KILO_QUIT_TIMES 3
 #define TAB_REPLACE 31
-
-#define HL_HIGHLIGHT_NUMBERS (1<<0)
-#define HL_HIGHLIGHT_STRINGS (1<<1)
-
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+#define KILO_STATUS_TIMEOUT 5
+#define KILO_FRAME_MS 16
+#define KILO_RESIDENT_FILES 8
+#define KILO_PAGER_THRESHOLD ((off_t) 256 << 20)
+#define KILO_SWITCH_TOP 5
+#define KILO_MAX_PANES 32
+#define KILO_PANE_MIN_COLS 16
 
 /*** prototypes ***/
 
+void die(const char * s);
+int editorReadKey();
+int getWindowSize(int * rows, int * cols, int force);
 void editorSetStatusMessage(const char * fmt, ...);
 void editorRefreshScreen();
+void editorRedraw();
+void editorFollow(efile * F);
 char * editorPrompt(char * prompt, void (* callback)(char *, int));
+char * editorPromptReply(char * prompt, void (* callback)(char *, int), int empty);
 void editorNewFile();
+void editorSwitchBuffer();
+int editorLoadPoll();
+void editorGotoPending();
+int editorDecodeKey(char c);
+void editorWrite(const char * buf, int len);
+int editorPaneShows(efile * F);
+void editorPaneForget(int index);
+void editorPaneResize();
+void editorSaveDone(efile * F);
+void editorIndexWords();
+void editorHexFind();
+void editorJumpOffset(efile * F, long long offset);
 
 /*** data ***/
 
-enum editorKey {
-	BACKSPACE = 127,
-	ARROW_LEFT = 0x200,
-	ARROW_RIGHT,
-	ARROW_UP,
-	ARROW_DOWN,
-	DEL_KEY,
-	HOME_KEY,
-	END_KEY,
-	PAGE_UP,
-	PAGE_DOWN,
-	SHIFT_ARROW_LEFT = 0x400,
-	SHIFT_ARROW_RIGHT,
-	SHIFT_ARROW_UP,
-	SHIFT_ARROW_DOWN,
-	SHIFT_TAB
-};
-
-enum editorHighlight {
-	HL_NORMAL = 0,
-	HL_COMMENT,
-	HL_MLCOMMENT,
-	HL_KEYWORD1,
-	HL_KEYWORD2,
-	HL_STRING,
-	HL_NUMBER,
-	HL_MATCH,
-	HL_SEL = 0,
-	HL_UNSEL = 1
-};
-
-struct editorSyntax {
-	char * filetype;
-	char ** filematch;
-	char ** keywords;
-	char * singleline_comment_start;
-	char * multiline_comment_start;
-	char * multiline_comment_end;
-	int flags;
-};
-
-typedef struct erow {
-	int idx;
-	int size;
-	int rsize;
-	char * chars;
-	char * render;
-	unsigned char * hl;
-	int hl_open_comment;
-} erow;
-
-typedef struct efile {
-	int index;
+/* a node of the pane tree: leaves show a file, splits divide their area
+ * between two children, 'h' one above the other and 'v' side by side */
+struct editorPane {
+	int used;
+	int split;
+	int child[2];
+	int parent;
+	int file;
 	int cx, cy;
 	int rx;
 	int rowoff;
 	int coloff;
-	int numrows;
-	erow * row;
-	int dirty;
-	int beginsel[2];
-	int endsel[2];
-	char * filename;
-	struct editorSyntax * syntax;
-} efile;
+	int top, left;
+	int rows, cols;
+};
 
 struct editorConfig {
 	int screenrows;
@@ -99,12 +66,76 @@ struct editorConfig {
 	char ** clipboard;
 	int numfiles;
 	int currentfile;
-	efile * file;
+	int filecap;
+	int numfree;
+	int * freefiles;
+	int numresident;
+	int lruhead;
+	int lrutail;
+	int numloading;
+	int numsaving;
+	efile ** file;
+	char input[64];
+	int inputlen;
+	int inputpos;
+	int redraw;
+	int repaint;
+	int frametimer;
+	long lastframe;
+	int inotify;
+	int followindex;
+	int pager;
+	int hex;
+	int hexfile;
+	off_t hexmatch;
+	int hexmatchlen;
+	int gotoindex;
+	int gotoline;
+	int wordtimer;
+	struct editorPane pane[KILO_MAX_PANES];
+	int rootpane;
+	int activepane;
+	struct abuf * frame;
+	int framelines;
+	int overlaid;
+	int matchfile;
+	int matchrow[2];
+	int matchcol[2];
+	int statustimer;
 	char statusmsg[80];
+	char prompthint[160];
 	time_t statusmsg_time;
 	struct termios orig_termios;
 };
 
+struct editorSwitcher {
+	char * names;
+	int * offsets;
+	int * lengths;
+	int * handles;
+	int numnames;
+	int * cand;
+	int numcand;
+	char query[128];
+	int top[KILO_SWITCH_TOP];
+	int topscore[KILO_SWITCH_TOP];
+	int numtop;
+	int selected;
+};
+
+/* Ctrl-Y cycles through the candidates while the cursor stays at the end
+ * of the inserted completion */
+struct editorCompletion {
+	int active;
+	int file;
+	int cy, cx;
+	int len;
+	int prefixlen;
+	char * cand[KILO_COMPLETIONS];
+	int numcand;
+	int selected;
+};
+
 struct abuf {
 	char * b;
 	int len;
@@ -122,48 +153,20 @@ void abFree(struct abuf * ab) {
 	free(ab->b);
 }
 
-void editorFreeRow(erow * row);
-
 struct editorConfig E;
-
-struct editorSyntax HLDB[] = {
-	{
-		"C",
-		C_HL_extensions,
-		C_HL_keywords,
-		"//", "/*", "*/",
-		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
-	},
-	{
-		"C++",
-		CPP_HL_extensions,
-		CPP_HL_keywords,
-		"//", "/*", "*/",
-		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
-	},
-	{
-		"Python",
-		PY_HL_extensions,
-		PY_HL_keywords,
-		"#", "'''", "'''",
-		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
-	},
-	{
-		"JavaScript",
-		JS_HL_extensions,
-		JS_HL_keywords,
-		"//", "/*", "*/",
-		HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS
-	}
-};
+struct editorSwitcher SW;
+struct editorCompletion CO;
 
 /*** terminal ***/
 
+#ifndef KILO_HEADLESS
+
 void die(const char * s) {
-	for (int i = 0; i < E.numfiles; i++) {
-		efile * F = &E.file[i];
+	for (int i = 0; i < E.filecap; i++) {
+		efile * F = E.file[i];
 		if (F) {
-			for (int j = 0; j < F->numrows; j++) editorFreeRow(&F->row[j]);
+			for (int j = 0; F->row && j < F->numrows; j++) editorFreeRow(&F->row[j]);
+			free(F->row);
 			free(F);
 		}
 	}
@@ -192,20 +195,52 @@ void enableRawMode() {
 	if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) die("tcsetattr");
 }
 
+void editorInputReady(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	if (E.inputpos > 0) {
+		memmove(E.input, &E.input[E.inputpos], E.inputlen - E.inputpos);
+		E.inputlen -= E.inputpos;
+		E.inputpos = 0;
+	}
+	int nread = read(STDIN_FILENO, &E.input[E.inputlen], sizeof(E.input) - E.inputlen);
+	if (nread == -1 && errno != EAGAIN && errno != EINTR) die("read");
+	if (nread > 0) E.inputlen += nread;
+}
+
+/* the rest of an escape sequence usually arrived with its first byte */
+int editorReadByte(char * c) {
+	if (E.inputpos < E.inputlen) {
+		*c = E.input[E.inputpos++];
+		return 1;
+	}
+	return read(STDIN_FILENO, c, 1) == 1;
+}
+
+/* runs the event loop until a byte of input is buffered, repainting when a
+ * load, resize or timer changed what is on screen */
 int editorReadKey() {
-	int nread;
-	char c;
-	while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-		if (nread == -1 && errno != EAGAIN) die("read");
+	while (E.inputpos == E.inputlen) {
+		if (editorLoopRun(-1) == -1 && errno != EINTR) die("editorLoopRun");
+		if (E.redraw && E.inputpos == E.inputlen) editorRedraw();
 	}
+	char c = E.input[E.inputpos++];
+
+	unsigned long start = editorStatStart();
+	int key = editorDecodeKey(c);
+	editorStatEnd(STAT_READKEY, start);
+	if (start && !ST.keytime) ST.keytime = start;
+	return key;
+}
 
+int editorDecodeKey(char c) {
 	if (c == '\x1b') {
 		char seq[5];
-		if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-		if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
+		if (!editorReadByte(&seq[0])) return '\x1b';
+		if (!editorReadByte(&seq[1])) return '\x1b';
 		if (seq[0] == '[') {
 			if (seq[1] >= '0' && seq[1] <= '9') {
-				if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
+				if (!editorReadByte(&seq[2])) return '\x1b';
 				if (seq[2] == '~') {
 					switch (seq[1]) {
 						case '1': return HOME_KEY;
@@ -217,8 +252,8 @@ int editorReadKey() {
 						case '8': return END_KEY;
 					}
 				} else if (seq[1] == '1' && seq[2] == ';') {
-					if (read(STDIN_FILENO, &seq[3], 1) != 1) return '\x1b';
-					if (read(STDIN_FILENO, &seq[4], 1) != 1) return '\x1b';
+					if (!editorReadByte(&seq[3])) return '\x1b';
+					if (!editorReadByte(&seq[4])) return '\x1b';
 					if (seq[3] == '2') {
 						switch (seq[4]) {
 							case 'A': return SHIFT_ARROW_UP;
@@ -247,7 +282,8 @@ int editorReadKey() {
 		}
 		return '\x1b';
 	}
-	return c;
+	/* bytes of UTF-8 text come through as themselves */
+	return (unsigned char) c;
 }
 
 int getCursorPosition(int *rows, int * cols) {
@@ -282,504 +318,563 @@ int getWindowSize(int *rows, int * cols, int force) {
 	}
 }
 
-/*** syntax highlighting ***/
+/* the window size is cached and only queried again on SIGWINCH; a failed
+ * ioctl keeps the old size rather than round-tripping through the terminal */
+void editorResize(void * arg, int sig) {
+	(void) arg;
+	(void) sig;
+	int rows, cols;
+	if (getWindowSize(&rows, &cols, 0) == -1) return;
+	if (rows == E.screenrows && cols == E.screencols) return;
+	E.screenrows = rows;
+	E.screencols = cols;
+	editorPaneResize();
+	E.repaint = 1;
+	E.redraw = 1;
+}
+
+void editorWrite(const char * buf, int len) {
+	write(STDOUT_FILENO, buf, len);
+}
+#endif
+
+/*** file loading ***/
 
-int is_separator(int c) {
-	return isspace(c) || c == '\0' || strchr(",.()+-/*=~%<>[];", c) != NULL;
+void editorLoadFinished(efile * F) {
+	E.numloading--;
+	if (F->error) editorSetStatusMessage("Read error after %d lines: %s", F->numrows, strerror(F->error));
+	else if (E.followindex == F->index) editorFollow(F);
+	editorIndexWords();
 }
 
-void removeHighlight() {
-	efile * F = &E.file[E.currentfile];
-	for (int i = 0; i < 2; i++) {
-		F->beginsel[i] = -1;
-		F->endsel[i] = -1;
+void editorLoadAbort(efile * F) {
+	editorLoadCancel(F);
+	E.numloading--;
+	editorSetStatusMessage("Load cancelled after %d lines, saving is disabled", F->numrows);
+}
+
+int editorLoadPoll() {
+	int drained = 0;
+	for (int i = 0; i < E.filecap && E.numloading > 0; i++) {
+		efile * F = E.file[i];
+		if (F == NULL || F->loader == NULL) continue;
+		drained += editorLoadDrain(F, KILO_LOAD_BUDGET);
+		if (F->loader == NULL) editorLoadFinished(F);
 	}
+	return drained;
 }
 
-void editorUpdateSyntax(erow *row) {
-	efile * F = &E.file[E.currentfile];
-	row->hl = realloc(row->hl, row->rsize);
-	memset(row->hl, HL_NORMAL, row->rsize);
-		
-	if (F->syntax == NULL) return;
-
-	char ** keywords = F->syntax->keywords;
-	char * scs = F->syntax->singleline_comment_start;
-	char * mcs = F->syntax->multiline_comment_start;
-	char * mce = F->syntax->multiline_comment_end;
-	int scs_len = scs ? strlen(scs) : 0;
-	int mcs_len = mcs ? strlen(mcs) : 0;
-	int mce_len = mce ? strlen(mce) : 0;
-
-	int prev_sep = 1;
-	int in_string = 0;
-	int in_comment = (row->idx > 0 && F->row[row->idx - 1].hl_open_comment);
-	
-	int i = 0;
-	while (i < row->rsize) {
-		char c = row->render[i];
-		unsigned char prev_hl = (i > 0) ? row->hl[i - 1] : HL_NORMAL;
+/*** follow ***/
+
+/* append new rows and keep a cursor that sat on the last line there */
+void editorFollowFile(efile * F) {
+	int fromend = F->numrows - F->cy;
+	int tail = (fromend <= 1);
+	editorFollowRead(F, KILO_LOAD_BUDGET);
+	if (tail) F->cy = (F->numrows > fromend) ? F->numrows - fromend : 0;
+	if (F->index == E.currentfile) E.redraw = 1;
+	if (F->follow->more) editorLoopWake();
+	editorIndexWords();
+}
 
-		if (scs_len && !in_string && !in_comment) {
-			if (!strncmp(&row->render[i], scs, scs_len)) {
-				memset(&row->hl[i], HL_COMMENT, row->rsize - i);
-				break;
-			}
-		}
-		
-		if (mcs_len && mce_len && !in_string) {
-			if (in_comment) {
-				row->hl[i] = HL_MLCOMMENT;
-				if (!strncmp(&row->render[i], mce, mce_len)) {
-					memset(&row->hl[i], HL_MLCOMMENT, mce_len);
-					i += mce_len;
-					in_comment = 0;
-					prev_sep = 1;
-					continue;
-				} else {
-					i++;
-					continue;
-				}
-			} else if (!strncmp(&row->render[i], mcs, mcs_len)) {
-				memset(&row->hl[i], HL_MLCOMMENT, mcs_len);
-				i += mcs_len;
-				in_comment = 1;
-				continue;
-			}
-		}
-		
-		if (F->syntax->flags & HL_HIGHLIGHT_STRINGS) {
-			if (in_string) {
-				row->hl[i] = HL_STRING;
-				if (c == '\\' && i + 1 < row->rsize) {
-					row->hl[i + 1] = HL_STRING;
-					i += 2;
-					continue;
-				}
-				if (c == in_string) in_string = 0;
-				i++;
-				prev_sep = 1;
-				continue;
-			} else {
-				if (c == '"' || c == '\'') {
-					in_string = c;
-					row->hl[i] = HL_STRING;
-					i++;
-					continue;
-				}
-			}
-		}
-		
-		if (F->syntax->flags & HL_HIGHLIGHT_NUMBERS) {
-			if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) {
-				row->hl[i] = HL_NUMBER;
-				i++;
-				prev_sep = 0;
-				continue;
+void editorFollowReady(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	ssize_t len;
+	/* a burst of writes is many events, each file is read once for all of them */
+	while ((len = read(E.inotify, buf, sizeof(buf))) > 0) {
+		for (char * p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *) p)->len) {
+			struct inotify_event * ev = (struct inotify_event *) p;
+			for (int i = 0; i < E.filecap; i++) {
+				efile * F = E.file[i];
+				if (F && F->follow && F->follow->wd == ev->wd) F->follow->more = 1;
 			}
 		}
+	}
+	for (int i = 0; i < E.filecap; i++) {
+		efile * F = E.file[i];
+		if (F && F->follow && F->follow->more) editorFollowFile(F);
+	}
+}
 
-		if (prev_sep) {
-			int j;
-			for (j = 0; keywords[j]; j++) {
-				int klen = strlen(keywords[j]);
-				int kw2 = keywords[j][klen - 1] == '|';
-				if (kw2) klen--;
-
-				if (!strncmp(&row->render[i], keywords[j], klen) && is_separator(row->render[i + klen])) {
-					memset(&row->hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
-					i += klen;
-					break;
-				}
-			}
-			if (keywords[j] != NULL) {
-				prev_sep = 0;
-				continue;
-			}
+void editorFollow(efile * F) {
+	E.followindex = -1;
+	if (E.inotify == -1) {
+		E.inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (E.inotify == -1) {
+			editorSetStatusMessage("Can't follow: %s", strerror(errno));
+			return;
 		}
-
-		prev_sep = is_separator(c);
-		i++;
+		editorLoopWatch(E.inotify, editorFollowReady, NULL);
+	}
+	if (editorFollowStart(F, E.inotify) == -1) {
+		editorSetStatusMessage("Can't follow %s: %s", F->filename ? F->filename : "[No Name]", strerror(errno));
+		return;
 	}
+	F->cy = F->numrows;
+	editorFollowFile(F);
+	editorSetStatusMessage("Following %s, Ctrl-E stops", F->filename);
+}
 
-	int changed = (row->hl_open_comment != in_comment);
-	row->hl_open_comment = in_comment;
-	if (changed && row->idx + 1 < F->numrows) editorUpdateSyntax(&F->row[row->idx + 1]);
+void editorToggleFollow() {
+	efile * F = E.file[E.currentfile];
+	if (F->follow) {
+		editorFollowStop(F);
+		editorSetStatusMessage("Stopped following %s", F->filename);
+	} else if (F->pager || F->hex || F->source) {
+		editorSetStatusMessage("Can't follow a read-only buffer");
+	} else if (F->codec) {
+		editorSetStatusMessage("Can't follow a %s compressed file", editorCodecName(F->codec));
+	} else if (F->loader) {
+		E.followindex = F->index;
+		editorSetStatusMessage("Following once the file has loaded");
+	} else {
+		editorFollow(F);
+	}
 }
 
-int editorSyntaxToColor(int hl) {
-	switch (hl) {
-		case HL_COMMENT:
-		case HL_MLCOMMENT: return 36;
-		case HL_KEYWORD1: return 33;
-		case HL_KEYWORD2: return 32;
-		case HL_STRING: return 35;
-		case HL_NUMBER: return 31;
-		case HL_MATCH: return 34;
-		default: return 37;
+/* the pager stops counting rows at KILO_PAGER_MAXROWS, say so when a file gets there */
+void editorPagerLimit(efile * F, int numrows) {
+	if (numrows < KILO_PAGER_MAXROWS && F->numrows == KILO_PAGER_MAXROWS) {
+		editorSetStatusMessage("%s has more than %d lines, the rest can't be shown", F->filename, KILO_PAGER_MAXROWS);
 	}
 }
 
-void editorSelectSyntaxHighlight() {
-	efile * F = &E.file[E.currentfile];
-	F->syntax = NULL;
-	if (F->filename == NULL) return;
-	
-	char * ext = strrchr(F->filename, '.');
-
-	for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
-		struct editorSyntax * s = &HLDB[j];
-		unsigned int i = 0;
-		while (s->filematch[i]) {
-			int is_ext = (s->filematch[i][0] == '.');
-			if ((is_ext && ext && !strcmp(ext, s->filematch[i])) || (!is_ext && strstr(F->filename, s->filematch[i]))) {
-				F->syntax = s;
-				for (int filerow = 0; filerow < F->numrows; filerow++) editorUpdateSyntax(&F->row[filerow]);
-				return;
-			}
-			i++;
+/* loader and save threads and followed files that ran out of budget wake the event loop */
+void editorWakeReady(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	if (editorLoadPoll()) {
+		E.redraw = 1;
+		editorLoopWake();
+	}
+	for (int i = 0; i < E.filecap; i++) {
+		efile * F = E.file[i];
+		if (F && F->follow && F->follow->more) editorFollowFile(F);
+		if (F && F->pager) {
+			int numrows = F->numrows;
+			if (editorPagerPoll(F) && i == E.currentfile) E.redraw = 1;
+			editorPagerLimit(F, numrows);
 		}
+		if (F && F->saver && editorSavePoll(F)) editorSaveDone(F);
 	}
+	if (E.gotoindex != -1) editorGotoPending();
 }
 
-/*** row operations ***/
+/*** workspace ***/
 
-int editorRowCxToRx(erow * row, int cx) {
-	int rx = 0;
-	for (int j = 0; j < cx; j++) {
-		if (row->chars[j] == '\t') rx += (KILO_TAB_STOP - 1) - (rx % KILO_TAB_STOP);
-		rx++;
-	}
-	return rx;
+void editorLruUnlink(efile * F) {
+	if (F->lruprev != -1) E.file[F->lruprev]->lrunext = F->lrunext;
+	else E.lruhead = F->lrunext;
+	if (F->lrunext != -1) E.file[F->lrunext]->lruprev = F->lruprev;
+	else E.lrutail = F->lruprev;
+	F->lruprev = F->lrunext = -1;
 }
 
-int editorRowRxToCx(erow * row, int rx) {
-	int cur_rx = 0;
-	int cx;
-	for (cx = 0; cx < row->size; cx++) {
-		if (row->chars[cx] == '\t') cur_rx += (KILO_TAB_STOP - 1) - (cur_rx % KILO_TAB_STOP);
-		cur_rx++;
-		if (cur_rx > rx) return cx;
-	}
-	return cx;
+void editorLruPush(efile * F) {
+	F->lruprev = -1;
+	F->lrunext = E.lruhead;
+	if (E.lruhead != -1) E.file[E.lruhead]->lruprev = F->index;
+	else E.lrutail = F->index;
+	E.lruhead = F->index;
 }
 
-void editorUpdateRow(erow * row) {
-	int tabs = 0;
-	for (int j = 0; j < row->size; j++) {
-		if (row->chars[j] == '\t') tabs++;
-	}
+void editorRestoreFile(efile * F) {
+	editorRestoreRows(F);
+	E.numresident++;
+	editorLruPush(F);
+}
 
-	free(row->render);
-	row->render = malloc(row->size + tabs*(KILO_TAB_STOP - 1) + 1);
+void editorEvictFile(efile * F) {
+	editorEvictRows(F);
+	editorLruUnlink(F);
+	E.numresident--;
+}
 
-	int idx = 0;
-	for (int j = 0; j < row->size; j++) {
-		if (row->chars[j] == '\t') {
-			row->render[idx++] = ' ';
-			while (idx % KILO_TAB_STOP != 0) row->render[idx++] = ' ';
-		} else row->render[idx++] = row->chars[j];
+void editorEvictFiles() {
+	int index = E.lrutail;
+	while (E.numresident > KILO_RESIDENT_FILES && index != -1) {
+		efile * F = E.file[index];
+		index = F->lruprev;
+		if (F->index != E.currentfile && !F->loader && E.file[E.currentfile]->source != F && !editorPaneShows(F)) editorEvictFile(F);
 	}
-	row->render[idx] = '\0';
-	row->rsize = idx;
-
-	editorUpdateSyntax(row);
 }
 
-void editorInsertRow(int at, char * s, size_t len) {
-	efile * F = &E.file[E.currentfile];
-	if (at < 0 || at > F->numrows) return;
-
-	F->row = realloc(F->row, sizeof(erow) * (F->numrows + 1));
-	memmove(&F->row[at + 1], &F->row[at], sizeof(erow) * (F->numrows - at));
-	for (int j = at + 1; j <= F->numrows; j++) F->row[j].idx++;
+void editorSwitchFile(int index) {
+	efile * F = E.file[index];
+	E.currentfile = index;
+	if (F->resident) {
+		editorLruUnlink(F);
+		editorLruPush(F);
+	} else {
+		editorRestoreFile(F);
+	}
+	/* a grep view draws the rows of its source */
+	if (F->source && !F->source->resident) editorRestoreFile(F->source);
+	editorEvictFiles();
+}
 
-	F->row[at].idx = at;
+void editorNextFile() {
+	editorSwitchFile(E.file[E.currentfile]->next);
+}
 
-	F->row[at].size = len;
-	F->row[at].chars = malloc(len + 1);
-	memcpy(F->row[at].chars, s, len);
-	F->row[at].chars[len] = '\0';
+void editorNewFile() {
+	if (E.numfree == 0) {
+		int filecap = E.filecap ? E.filecap * 2 : 8;
+		E.file = realloc(E.file, sizeof(efile *) * filecap);
+		E.freefiles = realloc(E.freefiles, sizeof(int) * filecap);
+		for (int i = filecap - 1; i >= E.filecap; i--) {
+			E.file[i] = NULL;
+			E.freefiles[E.numfree++] = i;
+		}
+		E.filecap = filecap;
+	}
 
-	F->row[at].rsize = 0;
-	F->row[at].render = NULL;
-	F->row[at].hl = NULL;
-	F->row[at].hl_open_comment = 0;
-	editorUpdateRow(&F->row[at]);
+	efile * F = editorCreateFile();
+	F->index = E.freefiles[--E.numfree];
 
-	F->numrows++;
-	F->dirty++;
-}
+	/* new files join the Shift+Tab ring right after the current one */
+	if (E.numfiles == 0) {
+		F->next = F->prev = F->index;
+	} else {
+		efile * cur = E.file[E.currentfile];
+		F->prev = cur->index;
+		F->next = cur->next;
+		E.file[cur->next]->prev = F->index;
+		cur->next = F->index;
+	}
 
-void editorFreeRow(erow * row) {
-	free(row->render);
-	free(row->chars);
-	free(row->hl);
+	E.file[F->index] = F;
+	E.numfiles++;
+	E.numresident++;
+	editorLruPush(F);
+	E.currentfile = F->index;
+	editorEvictFiles();
+	editorIndexWords();
 }
 
 void editorFreeFile(efile * F) {
+	/* views go with the file whose rows they show */
+	for (int i = 0; i < E.filecap; i++) {
+		if (E.file[i] && E.file[i]->source == F) editorFreeFile(E.file[i]);
+	}
 	int index = F->index;
-	for (int i = 0; i < F->numrows; i++) editorFreeRow(&F->row[i]);
-	if (index >= 0 && index < E.numfiles)
-		memmove(&E.file[index], &E.file[index + 1], sizeof(efile) * (E.numfiles - index - 1));
-	for (int i = index; i < E.numfiles - 1; i++) E.file[i].index--;
+	if (F->saver) editorSaveDone(F);
+	if (E.followindex == index) E.followindex = -1;
+	if (E.gotoindex == index) E.gotoindex = -1;
+	if (F->loader) editorLoadAbort(F);
+	if (F->resident) {
+		editorLruUnlink(F);
+		E.numresident--;
+	}
+	E.file[F->prev]->next = F->next;
+	E.file[F->next]->prev = F->prev;
+	int next = F->next;
+
+	editorDestroyFile(F);
+	E.file[index] = NULL;
+	E.freefiles[E.numfree++] = index;
 	E.numfiles--;
-	if (E.numfiles > 0) E.currentfile = 0;
+
+	if (E.numfiles > 0) editorSwitchFile(next);
 	else editorNewFile();
+	editorPaneForget(index);
 }
 
-void editorDelRow(int at) {
-	efile * F = &E.file[E.currentfile];
-	if (at < 0 || at >= F->numrows) return;
-	editorFreeRow(&F->row[at]);
-	memmove(&F->row[at], &F->row[at + 1], sizeof(erow) * (F->numrows - at - 1));
-	for (int j = at; j < F->numrows - 1; j++) F->row[j].idx--;	
+/*** panes ***/
+
+/* the active pane keeps its cursor and viewport in its file while it has
+ * the focus, the others keep theirs in the pane */
 
-	F->numrows--;
-	F->dirty++;
-	if (F->beginsel[0] != -1) removeHighlight();
+int editorPaneAlloc() {
+	for (int i = 0; i < KILO_MAX_PANES; i++) {
+		if (!E.pane[i].used) {
+			memset(&E.pane[i], 0, sizeof(struct editorPane));
+			E.pane[i].used = 1;
+			E.pane[i].parent = -1;
+			return i;
+		}
+	}
+	return -1;
 }
 
-void editorRowInsertChar(erow * row, int at, int c) {
-	efile * F = &E.file[E.currentfile];
-	if (at < 0 || at > row->size) at = row->size;
-	row->chars = realloc(row->chars, row->size + 2);
-	memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-	row->size++;
-	row->chars[at] = c;
-	editorUpdateRow(row);
-	F->dirty++;
-	if (F->beginsel[0] != -1) removeHighlight();
+/* a pane's last line is its status bar, a side by side split keeps a
+ * column between its children for the separator */
+void editorPaneLayout(int p, int top, int left, int height, int width) {
+	struct editorPane * P = &E.pane[p];
+	P->top = top;
+	P->left = left;
+	P->rows = height - 1;
+	P->cols = width;
+	if (P->split == 'h') {
+		int first = height / 2;
+		editorPaneLayout(P->child[0], top, left, first, width);
+		editorPaneLayout(P->child[1], top + first, left, height - first, width);
+	} else if (P->split == 'v') {
+		int first = (width - 1) / 2;
+		editorPaneLayout(P->child[0], top, left, height, first);
+		editorPaneLayout(P->child[1], top, left + first + 1, height, width - first - 1);
+	}
 }
 
-void editorRowAppendString(erow * row, char * s, size_t len) {
-	efile * F = &E.file[E.currentfile];
-	row->chars = realloc(row->chars, row->size + len + 1);
-	memcpy(&row->chars[row->size], s, len);
-	row->size += len;
-	row->chars[row->size] = '\0';
-	editorUpdateRow(row);
-	F->dirty++;
-	if (F->beginsel[0] != -1) removeHighlight();
+void editorPaneResize() {
+	editorPaneLayout(E.rootpane, 0, 0, E.screenrows + 1, E.screencols);
 }
 
-void editorRowDelChar(erow * row, int at) {
-	efile * F = &E.file[E.currentfile];
-	if (at < 0 || at > row->size) return;
-	memmove(&row->chars[at], &row->chars[at + 1], row->size - at);
-	row->size--;
-	editorUpdateRow(row);
-	F->dirty++;
-	if (F->beginsel[0] != -1) removeHighlight();
+void editorPaneSave() {
+	struct editorPane * P = &E.pane[E.activepane];
+	efile * F = E.file[E.currentfile];
+	P->file = E.currentfile;
+	P->cx = F->cx;
+	P->cy = F->cy;
+	P->rx = F->rx;
+	P->rowoff = F->rowoff;
+	P->coloff = F->coloff;
 }
 
-/*** editor operations ***/
+void editorPaneLoad(int p) {
+	struct editorPane * P = &E.pane[p];
+	E.activepane = p;
+	editorSwitchFile(P->file);
+	efile * F = E.file[P->file];
+	/* the file may have shrunk while another pane had it */
+	editorSetCursor(F, P->cy, P->cx);
+	F->rowoff = P->rowoff;
+	F->coloff = P->coloff;
+}
 
-void editorInsertChar(int c) {
-	efile * F = &E.file[E.currentfile];
-	if (F->cy == F->numrows) {
-		editorInsertRow(F->numrows, "", 0);
+/* leaves in screen order, left to right and top to bottom */
+int editorPaneLeaves(int p, int * leaves, int n) {
+	struct editorPane * P = &E.pane[p];
+	if (!P->split) {
+		leaves[n] = p;
+		return n + 1;
 	}
-	editorRowInsertChar(&F->row[F->cy], F->cx, c);
-	F->cx++;
+	n = editorPaneLeaves(P->child[0], leaves, n);
+	return editorPaneLeaves(P->child[1], leaves, n);
 }
 
-void editorInsertNewline() {
-	efile * F = &E.file[E.currentfile];
-	int indent = 0;
-	if (F->cx == 0) {
-		editorInsertRow(F->cy, "", 0);
-	} else {
-		erow * row = &F->row[F->cy];
-		editorInsertRow(F->cy + 1, &row->chars[F->cx], row->size - F->cx);
-		row = &F->row[F->cy];
-		row->size = F->cx;
-		row->chars[row->size] = '\0';
-		while (row->chars[indent] == ' ' || row->chars[indent] == '\t') {
-			editorRowInsertChar(&F->row[F->cy + 1], indent, row->chars[indent]);
-			indent++;
-		}
-		editorUpdateRow(row);
+/* panes other than the active one hold files that must stay resident */
+int editorPaneShows(efile * F) {
+	for (int i = 0; i < KILO_MAX_PANES; i++) {
+		struct editorPane * P = &E.pane[i];
+		if (!P->used || P->split || i == E.activepane) continue;
+		efile * G = E.file[P->file];
+		if (G && (G == F || G->source == F)) return 1;
 	}
-	F->cy++;
-	F->cx = indent;
+	return 0;
 }
 
-void editorCopyChars() {
-	efile * F = &E.file[E.currentfile];
-	if (F->beginsel[0] == -1) return;
-	
-	if (E.clipboard) {
-		free(E.clipboard);
-		E.clipboard = NULL;
+/* panes left on a freed file show the current one instead */
+void editorPaneForget(int index) {
+	efile * F = E.file[E.currentfile];
+	for (int i = 0; i < KILO_MAX_PANES; i++) {
+		struct editorPane * P = &E.pane[i];
+		if (!P->used || P->split || i == E.activepane || P->file != index) continue;
+		P->file = E.currentfile;
+		P->cx = F->cx;
+		P->cy = F->cy;
+		P->rowoff = F->rowoff;
+		P->coloff = F->coloff;
 	}
-	
-	int numrows = F->endsel[0] - F->beginsel[0] + 1;
-	E.clipboard = malloc(sizeof(char *) * (numrows + 1));
-	for (int i = 0; i < numrows; i++) {
-		int colbegin = (i == 0) ? F->beginsel[1] : 0;
-		int colend = (i == numrows - 1) ? F->endsel[1] : F->row[F->beginsel[0] + i].size;
-		E.clipboard[i] = malloc(sizeof(char) * (colend - colbegin + 1));
-		memcpy(E.clipboard[i], &F->row[F->beginsel[0] + i].chars[colbegin], colend - colbegin);	
-		E.clipboard[i][colend - colbegin] = '\0';
-	}
-	E.clipboard[numrows] = NULL;
-	E.clipboardrows = numrows;
-	editorSetStatusMessage("Copied %s (%d rows) to clipboard", E.clipboard[0], numrows);
 }
 
-void editorPasteChars() {
-	efile * F = &E.file[E.currentfile];
-	if (E.clipboard == NULL) return;
-	
-	char * row = E.clipboard[0];
-	int pos = -1;
-	while (row[++pos] != '\0') {
-		editorInsertChar(row[pos]);
+void editorPaneSplit(int split) {
+	int p = E.activepane;
+	if (split == 'h' ? E.pane[p].rows < 3 : E.pane[p].cols < 2 * KILO_PANE_MIN_COLS + 1) {
+		editorSetStatusMessage("Not enough room to split this pane");
+		return;
 	}
-	for (int i = 1; i < E.clipboardrows; i++) {
-		row = E.clipboard[i];
-		int len = -1;
-		while (row[++len] != '\0');
-		editorInsertRow(++F->cy, row, len);
+	int s = editorPaneAlloc();
+	int q = s == -1 ? -1 : editorPaneAlloc();
+	if (q == -1) {
+		if (s != -1) E.pane[s].used = 0;
+		editorSetStatusMessage("Too many panes");
+		return;
 	}
-	F->cx = 0;
-}
 
-void editorDuplicateRow() {
-	efile * F = &E.file[E.currentfile];
-	if (F->cy == F->numrows) return;
-	erow * row = &F->row[F->cy];
-	editorInsertRow(F->cy + 1, row->chars, row->size);
-	F->cy++;
+	/* the new pane starts out as a copy of the active one, which keeps the focus */
+	editorPaneSave();
+	E.pane[q] = E.pane[p];
+	E.pane[q].parent = s;
+	E.pane[s].split = split;
+	E.pane[s].child[0] = p;
+	E.pane[s].child[1] = q;
+	E.pane[s].parent = E.pane[p].parent;
+	int g = E.pane[p].parent;
+	if (g == -1) E.rootpane = s;
+	else E.pane[g].child[E.pane[g].child[1] == p] = s;
+	E.pane[p].parent = s;
+	editorPaneResize();
 }
 
-void editorDeleteRow() {
-	efile * F = &E.file[E.currentfile];
-	if (F->cy == F->numrows) return;
-	editorDelRow(F->cy);
-	F->cx = 0;
+void editorPaneNext() {
+	int leaves[KILO_MAX_PANES];
+	int n = editorPaneLeaves(E.rootpane, leaves, 0);
+	int i = 0;
+	while (leaves[i] != E.activepane) i++;
+	editorPaneSave();
+	editorPaneLoad(leaves[(i + 1) % n]);
 }
 
-void editorDelChar() {
-	efile * F = &E.file[E.currentfile];
-	if (F->cy == F->numrows) return;
-	if (F->cx == 0 && F->cy == 0) return;
+/* the sibling takes over the area of a closed pane */
+void editorPaneClose() {
+	int p = E.activepane;
+	int s = E.pane[p].parent;
+	if (s == -1) {
+		editorSetStatusMessage("Can't close the only pane");
+		return;
+	}
+	int sibling = E.pane[s].child[E.pane[s].child[0] == p];
+	int g = E.pane[s].parent;
+	E.pane[sibling].parent = g;
+	if (g == -1) E.rootpane = sibling;
+	else E.pane[g].child[E.pane[g].child[1] == s] = sibling;
+	E.pane[p].used = 0;
+	E.pane[s].used = 0;
+	editorPaneResize();
+
+	int leaf = sibling;
+	while (E.pane[leaf].split) leaf = E.pane[leaf].child[0];
+	editorPaneLoad(leaf);
+}
 
-	erow * row = &F->row[F->cy];
-	if (F->cx > 0) {
-		editorRowDelChar(row, F->cx - 1);
-		F->cx--;
-	} else {
-		F->cx = F->row[F->cy - 1].size;
-		editorRowAppendString(&F->row[F->cy - 1], row->chars, row->size);
-		editorDelRow(F->cy);
-		F->cy--;
+void editorPaneOnly() {
+	for (int i = 0; i < KILO_MAX_PANES; i++) {
+		if (i != E.activepane) E.pane[i].used = 0;
 	}
+	E.rootpane = E.activepane;
+	E.pane[E.activepane].parent = -1;
+	editorPaneResize();
 }
 
-/*** file i/o ***/
+/*** clipboard ***/
 
-char * editorRowsToString(int * buflen) {
-	efile * F = &E.file[E.currentfile];
-	int totlen = 0;
-	for (int j = 0; j < F->numrows; j++)
-		totlen += F->row[j].size + 1;
-	*buflen = totlen;
+void editorCopyChars() {
+	efile * F = E.file[E.currentfile];
+	int numrows;
+	char ** rows = editorCopyRows(F, &numrows);
+	if (rows == NULL) return;
 
-	char * buf = malloc(totlen);
-	char * p = buf;
-	for (int j = 0; j < F->numrows; j++) {
-		memcpy(p, F->row[j].chars, F->row[j].size);
-		p += F->row[j].size;
-		*p = '\n';
-		p++;
+	if (E.clipboard) {
+		for (int i = 0; i < E.clipboardrows; i++) free(E.clipboard[i]);
+		free(E.clipboard);
 	}
-	return buf;
+	E.clipboard = rows;
+	E.clipboardrows = numrows;
+	editorSetStatusMessage("Copied %s (%d rows) to clipboard", E.clipboard[0], numrows);
 }
 
-void editorNewFile() {
-	efile F;
-	
-	F.index = E.numfiles;
-	F.cx = 0;
-	F.cy = 0;
-	F.rx = 0;
-	F.rowoff = 0;
-	F.coloff = 0;
-	F.numrows = 0;
-	F.row = NULL;
-	F.dirty = 0;
-	F.filename = NULL;
-	F.syntax = NULL;
-	
-	for (int i = 0; i < 2; i++) {
-		F.beginsel[i] = -1;
-		F.endsel[i] = -1;	
-	}
-	
-	E.file = realloc(E.file, sizeof(efile) * (E.numfiles + 1));
-	memcpy(&E.file[E.numfiles], &F, sizeof(efile));
-	E.currentfile = E.numfiles;
-	E.numfiles++;
+void editorPasteChars() {
+	editorPasteRows(E.file[E.currentfile], E.clipboard, E.clipboardrows);
 }
 
-void editorOpen(char * filename) {
-	FILE * fp = fopen(filename, "r");
-	if (!fp) {
+/*** file i/o ***/
+
+/* 0 once the file has a buffer, -1 with the reason on the status line */
+int editorOpen(char * filename) {
+	unsigned long start = editorStatStart();
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1) {
 		editorSetStatusMessage("Could not open file %s", filename); // die("fopen");
-		return;
+		return -1;
+	}
+	int codec = editorCodecDetect(fd);
+	if (!editorCodecAvailable(codec)) {
+		editorSetStatusMessage("Can't open %s: no %s support, libzstd.so.1 not found", filename, editorCodecName(codec));
+		close(fd);
+		return -1;
 	}
 	editorNewFile();
-	efile * F = &E.file[E.currentfile];
+	efile * F = E.file[E.currentfile];
 	F->filename = strdup(filename);
-	editorSelectSyntaxHighlight();
-	
-	char * line = NULL;
-	size_t linecap = 0;
-	ssize_t linelen;
-	while ((linelen = getline(&line, &linecap, fp)) != -1) {
-		while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r')) linelen--;
-		editorInsertRow(F->numrows, line, linelen);
+	F->codec = codec;
+
+	/* binaries are shown in hex and huge files paged, both straight from a
+	 * mapping instead of being read into rows; compressed files are
+	 * decompressed by the loader as they stream in */
+	if (codec == CODEC_NONE && (E.hex || editorIsBinary(fd)) && editorHexOpen(F, fd) == 0) {
+		editorSetStatusMessage("%s opened read-only in hex", filename);
+		editorStatEnd(STAT_OPEN, start);
+		return 0;
+	}
+	struct stat st;
+	if (codec == CODEC_NONE && (E.pager || (fstat(fd, &st) == 0 && st.st_size >= KILO_PAGER_THRESHOLD)) && editorPagerOpen(F, fd) == 0) {
+		editorSelectSyntaxHighlight(F);
+		editorSetStatusMessage("%s opened read-only in the pager", filename);
+		editorPagerLimit(F, 0);
+		editorStatEnd(STAT_OPEN, start);
+		return 0;
+	}
+	editorSelectSyntaxHighlight(F);
+
+	/* rows are read on a worker thread and appended as they arrive */
+	int ret = editorLoadStart(F, fd, E.screenrows);
+	if (ret == -1) die("pthread_create");
+	if (ret == -2) {
+		close(fd);
+		editorFreeFile(F);
+		editorSetStatusMessage("Can't open %s: %s decompression failed to start", filename, editorCodecName(codec));
+		return -1;
+	}
+	E.numloading++;
+	editorLoadWait(F);
+	if (F->loader == NULL) editorLoadFinished(F);
+	editorStatEnd(STAT_OPEN, start);
+	return 0;
+}
+
+/* a background save has finished writing; edits made meanwhile keep the
+ * file dirty */
+void editorSaveDone(efile * F) {
+	off_t written;
+	int error = editorSaveFinish(F, &written);
+	E.numsaving--;
+	/* the save renamed a new file into place, a follow watches the old one */
+	if (error == 0 && F->follow) {
+		editorFollowStop(F);
+		editorFollowStart(F, E.inotify);
 	}
-	free(line);
-	fclose(fp);
-	F->dirty = 0;
+	if (error == 0) editorSetStatusMessage("%lld bytes written to disk", (long long) written);
+	else editorSetStatusMessage("Can't save %s! I/O error: %s", F->filename, strerror(error));
+	E.redraw = 1;
 }
 
 void editorSave() {
-	efile * F = &E.file[E.currentfile];
+	efile * F = E.file[E.currentfile];
 	if (F->filename == NULL) {
 		F->filename = editorPrompt("Save as: %s", NULL);
 		if (F->filename == NULL) {
 			editorSetStatusMessage("Save aborted");
 			return;
 		}
-		editorSelectSyntaxHighlight();
+		F->codec = editorCodecFromName(F->filename);
+		editorSelectSyntaxHighlight(F);
 	}
-
-	int len;
-	char * buf = editorRowsToString(&len);
-
-	int fd = open(F->filename, O_RDWR | O_CREAT, 0644);
-	if (fd != -1) {
-		if (ftruncate(fd, len) != -1) {
-			if (write(fd, buf, len) == len) {
-				close(fd);
-				free(buf);
-				F->dirty = 0;
-				editorSetStatusMessage("%d bytes written to disk", len);
-				return;
-			}
-		}
-		close(fd);
+	if (F->loader) {
+		editorSetStatusMessage("Can't save while the file is still loading");
+		return;
+	}
+	if (F->partial) {
+		editorSetStatusMessage("Can't save! File was only partially loaded");
+		return;
+	}
+	if (F->saving) {
+		editorSetStatusMessage("Still saving %s", F->filename);
+		return;
 	}
-	free(buf);
-	editorSetStatusMessage("Can't save! I/O error: %s", strerror(errno));
-}
 
-void editorNextFile() {
-	E.currentfile = (E.currentfile + 1) % E.numfiles;
+	/* only the row pointers are captured here, a thread writes the file
+	 * while editing goes on; the stat is the time the editor was held up */
+	unsigned long start = editorStatStart();
+	if (editorSaveStart(F) == -1) {
+		editorSetStatusMessage("Can't save! %s", strerror(errno));
+		return;
+	}
+	E.numsaving++;
+	editorStatEnd(STAT_SAVE, start);
+	editorSetStatusMessage("Saving %s...", F->filename);
 }
 
 /*** find ***/
@@ -789,12 +884,17 @@ void editorFindCallback(char * query, int key) {
 	static int direction = 1;
 
 	static int saved_hl_line;
+	static int saved_hl_len;
 	static char * saved_hl = NULL;
 
-	efile * F = &E.file[E.currentfile];
+	efile * F = E.file[E.currentfile];
+	unsigned long start = editorStatStart();
 
+	/* a followed file may have grown, cut or reloaded the row since */
 	if (saved_hl) {
-		memcpy(F->row[saved_hl_line].hl, saved_hl, F->row[saved_hl_line].rsize);
+		erow * row = (saved_hl_line < F->numrows) ? editorFileRow(F, saved_hl_line) : NULL;
+		int len = (row && row->rsize < saved_hl_len) ? row->rsize : saved_hl_len;
+		if (row && row->hl) memcpy(row->hl, saved_hl, len);
 		free(saved_hl);
 		saved_hl = NULL;
 	}
@@ -802,6 +902,7 @@ void editorFindCallback(char * query, int key) {
 	if (key == '\r' || key == '\x1b') {
 		last_match = -1;
 		direction = 1;
+		editorStatEnd(STAT_FIND, start);
 		return;
 	} else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
 		direction = 1;
@@ -813,31 +914,31 @@ void editorFindCallback(char * query, int key) {
 	}
 
 	if (last_match == -1) direction = 1;
-	int current = last_match;
-	for (int i = 0; i < F->numrows; i++) {
-		current += direction;
-		if (current == -1) current = F->numrows - 1;
-		else if (current == F->numrows) current = 0;		
-
-		erow * row = &F->row[current];
-		char * match = strcasestr(row->render, query);
-		if (match) {
-			last_match = current;
-			F->cy = current;
-			F->cx = editorRowRxToCx(row, match - row->render);
-			F->rowoff = F->numrows;
-
-			saved_hl_line = current;
-			saved_hl = malloc(row->rsize);
-			memcpy(saved_hl, row->hl, row->rsize);
-			memset(&row->hl[match - row->render], HL_MATCH, strlen(query));
-			break;
-		}
+	int rx;
+	int current = editorFindRow(F, query, last_match, direction, &rx);
+	if (current != -1) {
+		erow * row = editorFileRow(F, current);
+		last_match = current;
+		editorUnfold(F, current);
+		F->cy = current;
+		F->cx = editorRowRenderToCx(row, rx);
+		F->rowoff = F->numrows;
+
+		saved_hl_line = current;
+		saved_hl_len = row->rsize;
+		saved_hl = malloc(row->rsize);
+		memcpy(saved_hl, row->hl, row->rsize);
+		memset(&row->hl[rx], HL_MATCH, strlen(query));
 	}
+	editorStatEnd(STAT_FIND, start);
 }
 
 void editorFind() {
-	efile * F = &E.file[E.currentfile];
+	efile * F = E.file[E.currentfile];
+	if (F->hex) {
+		editorHexFind();
+		return;
+	}
 	int saved_cx = F->cx;
 	int saved_cy = F->cy;
 	int saved_coloff = F->coloff;
@@ -853,131 +954,674 @@ void editorFind() {
 	}
 }
 
-/*** input ***/
+/*** replace ***/
 
-char * editorPrompt(char * prompt, void (* callback)(char *, int)) {
-	size_t bufsize = 128;
-	char * buf = malloc(bufsize);
-	
-	size_t buflen = 0;
-	buf[0] = '\0';
+/* query-replace from the cursor to the end of the buffer */
+void editorReplace() {
+	efile * F = E.file[E.currentfile];
+	char * query = editorPrompt("Replace: %s", NULL);
+	if (query == NULL) return;
+	char * with = editorPromptReply("Replace with: %s", NULL, 1);
+	if (with == NULL) {
+		free(query);
+		return;
+	}
 
-	while (1) {
-		editorSetStatusMessage(prompt, buf);
+	int qlen = strlen(query);
+	int wlen = strlen(with);
+	int cy = F->cy, cx = F->cx;
+	int replaced = 0, changed = 0;
+	long total = 0;
+	while (editorFindChars(F, query, &cy, &cx)) {
+		erow * row = editorFileRow(F, cy);
+		F->cy = cy;
+		F->cx = cx;
+
+		int rx = editorRowCxToRender(row, cx);
+		int rxend = editorRowCxToRender(row, cx + qlen);
+		unsigned char * saved_hl = malloc(rxend - rx);
+		memcpy(saved_hl, &row->hl[rx], rxend - rx);
+		memset(&row->hl[rx], HL_MATCH, rxend - rx);
+		editorSetStatusMessage("Replace? y = yes, n = no, a = all the rest, ESC = stop");
 		editorRefreshScreen();
-
 		int c = editorReadKey();
-		if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {		
-			if (buflen != 0) buf[--buflen] = '\0';
-		} else if (c == '\x1b') {
-			editorSetStatusMessage("");
-			if (callback) callback(buf, c);
-			free(buf);
-			return NULL;
-		} else if (c == '\r') {
-			if (buflen != 0) {
-				editorSetStatusMessage("");
-				if (callback) callback(buf, c);
-				return buf;
-			}
-		} else if (!iscntrl(c) && c < 128) {
-			if (buflen == bufsize - 1) {
-				bufsize *= 2;
-				buf = realloc(buf, bufsize);
-			}
-			buf[buflen++] = c;
-			buf[buflen] = '\0';
+
+		/* the key was read through the event loop, where loader batches and
+		 * follow appends may have moved the rows or a truncation dropped them */
+		row = (cy < F->numrows) ? editorFileRow(F, cy) : NULL;
+		int found = row && cx + qlen <= row->size && strncasecmp(&row->chars[cx], query, qlen) == 0;
+		if (found) memcpy(&row->hl[rx], saved_hl, rxend - rx);
+		free(saved_hl);
+		if (!found) {
+			changed = 1;
+			break;
 		}
 
-		if (callback) callback(buf, c);
+		if (c == 'y') {
+			editorReplaceMatch(F, row, cx, query, with);
+			replaced++;
+			cx += wlen;
+		} else if (c == 'n') {
+			cx++;
+		} else if (c == 'a') {
+			total += editorReplaceAll(F, query, with, cy, cx);
+			break;
+		} else {
+			break;
+		}
 	}
+
+	/* the whole run counts as one change */
+	if (replaced > 0) F->dirty++;
+	total += replaced;
+	editorSetStatusMessage("Replaced %ld occurrence%s%s", total, total == 1 ? "" : "s",
+		changed ? ", stopped as the buffer changed" : "");
+	free(query);
+	free(with);
 }
 
-void editorMoveCursor(int key) {
-	efile * F = &E.file[E.currentfile];
-	erow * row = (F->cy >= F->numrows) ? NULL : &F->row[F->cy];
-	int opos[2] = {F->cy, F->cx};
+/*** goto ***/
+
+/* land on row at with it centred, without walking the cursor there */
+void editorJump(efile * F, int at) {
+	int rows = E.pane[E.activepane].rows;
+	editorUnfold(F, at);
+	editorSetCursor(F, at, 0);
+	int top = editorFoldVisible(F, F->cy) - rows / 2;
+	if (top > editorFoldRows(F) - rows) top = editorFoldRows(F) - rows;
+	if (top < 0) top = 0;
+	F->rowoff = editorFoldRow(F, top);
+}
 
-	/* moving */
-	switch (key) {
-		case ARROW_LEFT:
-		case SHIFT_ARROW_LEFT:
-			if (F->cx != 0) F->cx--;
-			else if (F->cy > 0) {
-				F->cy--;
-				F->cx = F->row[F->cy].size;
-			}
-			break;
-			
-		case ARROW_RIGHT:
-		case SHIFT_ARROW_RIGHT:
-			if (row && F->cx < row->size) F->cx++;
-			else if (row && F->cx == row->size) {
-				F->cy++;
-				F->cx = 0;
-			}
-			break;
-			
-		case ARROW_UP:
-		case SHIFT_ARROW_UP:
-			if (F->cy != 0) F->cy--;
-			break;
-			
-		case ARROW_DOWN:
-		case SHIFT_ARROW_DOWN:
-			if (F->cy < F->numrows) F->cy++;
-			break;
-			
-		case HOME_KEY:
-			F->cx = 0;
-			break;
-			
-		case END_KEY:
-			if (F->cy < F->numrows) F->cx = F->row[F->cy].size;
-			break;
-	}
-	
-	int npos[2] = {F->cy, F->cx};
-	
-	if (SHIFT_KEY(key)) {
-		if (F->beginsel[0] == -1) {
-			for (int i = 0; i < 2; i++) {
-				F->beginsel[i] = (key == SHIFT_ARROW_LEFT) ? npos[i] : opos[i];
-				F->endsel[i] = (key == SHIFT_ARROW_LEFT) ? opos[i] : npos[i];
-			}
-		} else if (opos[0] == F->beginsel[0] && opos[1] == F->beginsel[1]) {
-			F->beginsel[0] = (npos[0] <= F->endsel[0]) ? npos[0] : F->beginsel[0];
-			F->beginsel[1] = (npos[0] < F->endsel[0] || npos[1] < F->endsel[1]) ? npos[1] : F->beginsel[1];
-		} else if (opos[0] == F->endsel[0] && opos[1] == F->endsel[1]) {
-			F->endsel[0] = (npos[0] >= F->beginsel[0]) ? npos[0] : F->endsel[0];
-			F->endsel[1] = (npos[0] > F->beginsel[0] || npos[1] > F->beginsel[1]) ? npos[1] : F->endsel[1];
-		}
-		//editorSetStatusMessage("(%d, %d) -> (%d, %d)", F->beginsel[0], F->beginsel[1], F->endsel[0], F->endsel[1]);
-	} else removeHighlight();
-	
-	row = (F->cy >= F->numrows) ? NULL : &F->row[F->cy];
-	int rowlen = row ? row->size : 0;
-	if (F->cx > rowlen) F->cx = rowlen;
+/* a hex view goes to a byte offset instead */
+void editorJumpOffset(efile * F, long long offset) {
+	if (offset >= F->size) offset = F->size - 1;
+	if (offset < 0) offset = 0;
+	editorJump(F, offset / KILO_HEX_WIDTH);
+	editorSetCursor(F, F->cy, offset % KILO_HEX_WIDTH);
 }
 
-void editorProcessKeypress() {
-	efile * F = &E.file[E.currentfile];
-	
+int editorStillLoading(efile * F) {
+	return F->loader || (F->pager && editorPagerProgress(F) < 100);
+}
+
+/* lines past what has been read so far are reached once the load gets there */
+void editorGotoLine(efile * F, int line) {
+	if (line > F->numrows && editorStillLoading(F)) {
+		E.gotoindex = F->index;
+		E.gotoline = line;
+		editorSetStatusMessage("Going to line %d once it has loaded", line);
+		return;
+	}
+	E.gotoindex = -1;
+	editorJump(F, line - 1);
+}
+
+void editorGotoPending() {
+	efile * F = E.file[E.gotoindex];
+	if (F->numrows < E.gotoline && editorStillLoading(F)) return;
+	editorGotoLine(F, E.gotoline);
+	E.redraw = 1;
+}
+
+void editorGoto() {
+	efile * F = E.file[E.currentfile];
+	char * target = editorPrompt(F->hex ? "Go to offset or bookmark: %s" : "Go to line or bookmark: %s", NULL);
+	if (target == NULL) return;
+
+	char * end;
+	long long n = strtoll(target, &end, F->hex ? 0 : 10);
+	if (*end == '\0') {
+		if (F->hex) editorJumpOffset(F, n);
+		else editorGotoLine(F, (n < 1) ? 1 : (n > INT_MAX) ? INT_MAX : n);
+	} else {
+		int at = editorGetMark(F, target);
+		if (at == -1) editorSetStatusMessage("No bookmark named %s", target);
+		else editorJump(F, at);
+	}
+	free(target);
+}
+
+void editorBookmark() {
+	efile * F = E.file[E.currentfile];
+	char prompt[48];
+	snprintf(prompt, sizeof(prompt), "Bookmark line %d as: %%s", F->cy + 1);
+	char * name = editorPrompt(prompt, NULL);
+	if (name == NULL) return;
+	editorSetMark(F, name, F->cy);
+	editorSetStatusMessage("Bookmark %s set on line %d", name, F->cy + 1);
+	free(name);
+}
+
+/*** hex search ***/
+
+/* the match stays marked while the prompt is open, arrows move between
+ * matches as in find */
+void editorHexFindCallback(char * query, int key) {
+	static off_t last_match = -1;
+	static int direction = 1;
+
+	efile * F = E.file[E.currentfile];
+	unsigned long start = editorStatStart();
+	E.hexfile = -1;
+
+	if (key == '\r' || key == '\x1b') {
+		last_match = -1;
+		direction = 1;
+		editorStatEnd(STAT_FIND, start);
+		return;
+	} else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
+		direction = 1;
+	} else if (key == ARROW_LEFT || key == ARROW_UP) {
+		direction = -1;
+	} else {
+		last_match = -1;
+		direction = 1;
+	}
+
+	/* a new query is looked for from the cursor on */
+	if (last_match == -1) direction = 1;
+	char * pattern = malloc(strlen(query) + 1);
+	int len = editorHexPattern(query, pattern);
+	off_t from = (last_match == -1) ? editorHexOffset(F) - 1 : last_match;
+	off_t at = editorHexSearch(F, pattern, len, from, direction);
+	free(pattern);
+	if (at != -1) {
+		last_match = at;
+		editorJumpOffset(F, at);
+		E.hexfile = F->index;
+		E.hexmatch = at;
+		E.hexmatchlen = len;
+	}
+	editorStatEnd(STAT_FIND, start);
+}
+
+void editorHexFind() {
+	efile * F = E.file[E.currentfile];
+	int saved_cx = F->cx;
+	int saved_cy = F->cy;
+	int saved_rowoff = F->rowoff;
+
+	char * query = editorPrompt("Search bytes: %s (hex pairs or text, ESC/Arrows/Enter)", editorHexFindCallback);
+	if (query) free(query);
+	else {
+		F->cx = saved_cx;
+		F->cy = saved_cy;
+		F->rowoff = saved_rowoff;
+	}
+}
+
+/*** folds ***/
+
+/* folds the block around the cursor, or opens the fold on its row */
+void editorToggleFold() {
+	efile * F = E.file[E.currentfile];
+	if (F->pager || F->hex) {
+		editorSetStatusMessage("Can't fold a file opened %s", F->hex ? "in hex" : "in the pager");
+		return;
+	}
+	if (editorUnfold(F, F->cy)) return;
+	int start, end;
+	if (editorFoldRange(F, F->cy, &start, &end) == -1) {
+		editorSetStatusMessage("No block to fold here");
+		return;
+	}
+	editorFold(F, start, end);
+	editorSetCursor(F, start, F->cx);
+	editorSetStatusMessage("Folded %d lines", end - start);
+}
+
+/*** brackets ***/
+
+/* render column of the bracket under the cursor or just before it, -1 if none */
+int editorCursorBracket(efile * F) {
+	if (F->cy >= F->numrows || F->pager || F->hex || F->source) return -1;
+	erow * row = &F->row[F->cy];
+	int rx = editorRowCxToRender(row, F->cx);
+	if (rx < row->rsize && editorIsBracket(row, rx)) return rx;
+	if (rx > 0 && rx <= row->rsize && editorIsBracket(row, rx - 1)) return rx - 1;
+	return -1;
+}
+
+void editorGotoBracket(int enclosing) {
+	efile * F = E.file[E.currentfile];
+	int y, x, ret;
+	if (F->hex) {
+		editorSetStatusMessage("No brackets in a file opened in hex");
+		return;
+	}
+	if (enclosing) {
+		int rx = (F->cy < F->numrows) ? editorRowCxToRender(editorFileRow(F, F->cy), F->cx) : 0;
+		ret = editorEnclosingBracket(F, F->cy, rx, &y, &x);
+	} else {
+		int rx = editorCursorBracket(F);
+		ret = (rx == -1) ? -1 : editorMatchBracket(F, F->cy, rx, &y, &x);
+	}
+	if (ret == -1) {
+		editorSetStatusMessage(enclosing ? "Not inside a block" : "No matching bracket");
+		return;
+	}
+	editorUnfold(F, y);
+	editorSetCursor(F, y, editorRowRenderToCx(&F->row[y], x));
+}
+
+/*** columns ***/
+
+/* the aligned view of a CSV or TSV file is on by default; turning it on
+ * again samples the column widths afresh */
+void editorToggleColumns() {
+	efile * F = E.file[E.currentfile];
+	if (editorFieldSeparator(F->syntax) == 0) {
+		editorSetStatusMessage("Only CSV and TSV files can be aligned");
+	} else if (F->columns) {
+		editorColumnsStop(F);
+		editorSetStatusMessage("Columns shown as written");
+	} else {
+		editorColumnsStart(F);
+		editorSetStatusMessage("Columns aligned");
+	}
+}
+
+void editorGotoColumn() {
+	efile * F = E.file[E.currentfile];
+	int sep = editorFieldSeparator(F->syntax);
+	if (sep == 0 || F->cy >= F->numrows) {
+		editorSetStatusMessage("No columns here");
+		return;
+	}
+	char * target = editorPrompt("Go to column: %s", NULL);
+	if (target == NULL) return;
+	int n = atoi(target);
+	free(target);
+
+	erow * row = editorFileRow(F, F->cy);
+	int * fields = editorRowFields(row, sep);
+	if (n < 1 || n > fields[0]) {
+		editorSetStatusMessage("Line %d has %d column%s", F->cy + 1, fields[0], fields[0] == 1 ? "" : "s");
+		return;
+	}
+	editorSetCursor(F, F->cy, editorRowRenderToCx(row, fields[2 * n - 1]));
+}
+
+/*** completion ***/
+
+/* buffers are added to the word index a slice at a time between keys */
+void editorIndexSlice(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	E.wordtimer = 0;
+	editorIndexWords();
+}
+
+void editorIndexWords() {
+	if (E.wordtimer) return;
+	for (int i = 0; i < E.filecap; i++) {
+		efile * F = E.file[i];
+		if (F == NULL || F->pager || F->hex || F->source || F->loader || F->wordrows == F->numrows) continue;
+		editorWordsScan(F, KILO_LOAD_BUDGET);
+		E.wordtimer = 1;
+		editorLoopTimer(1, editorIndexSlice, NULL);
+		return;
+	}
+}
+
+void editorCompletionClear() {
+	for (int i = 0; i < CO.numcand; i++) free(CO.cand[i]);
+	CO.numcand = 0;
+	CO.active = 0;
+}
+
+/* completes the identifier before the cursor from every open buffer,
+ * pressed again it replaces the completion with the next candidate */
+void editorComplete() {
+	efile * F = E.file[E.currentfile];
+	if (CO.active && (CO.file != F->index || CO.cy != F->cy || CO.cx != F->cx)) editorCompletionClear();
+
+	if (!CO.active) {
+		if (F->cy >= F->numrows) return;
+		erow * row = &F->row[F->cy];
+		int start = F->cx;
+		while (start > 0 && editorIsWordChar((unsigned char) row->chars[start - 1])) start--;
+		CO.prefixlen = F->cx - start;
+		if (CO.prefixlen == 0) {
+			editorSetStatusMessage("No word before the cursor to complete");
+			return;
+		}
+		if (F->wordrows < F->numrows) editorWordsScan(F, KILO_LOAD_BUDGET);
+		char * cand[KILO_COMPLETIONS];
+		CO.numcand = editorWordsComplete(&row->chars[start], CO.prefixlen, cand, KILO_COMPLETIONS);
+		if (CO.numcand == 0) {
+			editorSetStatusMessage("No completions for %.*s", CO.prefixlen, &row->chars[start]);
+			return;
+		}
+		for (int i = 0; i < CO.numcand; i++) CO.cand[i] = strdup(cand[i]);
+		CO.active = 1;
+		CO.file = F->index;
+		CO.selected = -1;
+		CO.len = 0;
+	}
+
+	for (int i = 0; i < CO.len; i++) editorDelChar(F);
+	CO.selected = (CO.selected + 1) % CO.numcand;
+	char * word = CO.cand[CO.selected];
+	CO.len = strlen(word) - CO.prefixlen;
+	for (int i = 0; i < CO.len; i++) editorInsertChar(F, word[CO.prefixlen + i]);
+	CO.cy = F->cy;
+	CO.cx = F->cx;
+	editorSetStatusMessage("%s (%d of %d%s)", word, CO.selected + 1, CO.numcand,
+		CO.numcand == KILO_COMPLETIONS ? "+" : "");
+}
+
+/*** grep view ***/
+
+void editorGrepView() {
+	efile * src = E.file[E.currentfile];
+	if (src->pager || src->hex) {
+		editorSetStatusMessage("Can't grep a file opened %s, use find", src->hex ? "in hex" : "in the pager");
+		return;
+	}
+	char * pattern = editorPrompt("Grep: %s", NULL);
+	if (pattern == NULL) return;
+
+	editorNewFile();
+	efile * V = E.file[E.currentfile];
+	int numrefs = editorGrep(V, src, pattern);
+	V->filename = malloc(strlen(pattern) + 6);
+	sprintf(V->filename, "grep %s", pattern);
+	editorSetStatusMessage("%d lines of %s match, Enter jumps to one", numrefs, src->filename ? src->filename : "[No Name]");
+	free(pattern);
+}
+
+/* Enter in a grep view goes to the line in its source */
+void editorGrepJump(efile * V) {
+	if (V->cy >= V->numrows) return;
+	efile * src = V->source;
+	int line = V->refs[V->cy];
+	editorSwitchFile(src->index);
+	editorJump(src, line);
+}
+
+/*** buffer switcher ***/
+
+/* fuzzy subsequence score of a lowercased name, -1 if the query does not match */
+int editorFuzzyScore(const char * name, int len, const char * query, int qlen) {
+	int base = len;
+	while (base > 0 && name[base - 1] != '/') base--;
+
+	int score = 0;
+	int last = -2;
+	int j = 0;
+	for (int i = 0; i < len && j < qlen; i++) {
+		if (name[i] != query[j]) continue;
+		score += 1;
+		if (i == last + 1) score += 8;
+		if (i == 0 || strchr("/_-. ", name[i - 1])) score += 6;
+		if (i >= base) score += 2;
+		last = i;
+		j++;
+	}
+	if (j < qlen) return -1;
+	return score * 1024 + (len < 1024 ? 1023 - len : 0);
+}
+
+void editorSwitcherOpen() {
+	int total = 0;
+	for (int i = 0; i < E.filecap; i++) {
+		if (E.file[i]) total += (E.file[i]->filename ? strlen(E.file[i]->filename) : 9) + 1;
+	}
+
+	SW.names = malloc(total);
+	SW.offsets = malloc(sizeof(int) * E.numfiles);
+	SW.lengths = malloc(sizeof(int) * E.numfiles);
+	SW.handles = malloc(sizeof(int) * E.numfiles);
+	SW.cand = malloc(sizeof(int) * E.numfiles);
+	SW.numnames = 0;
+	SW.numcand = 0;
+	SW.query[0] = '\0';
+	SW.numtop = 0;
+	SW.selected = 0;
+
+	/* lowercased names packed into one buffer so scoring streams through memory */
+	int off = 0;
+	for (int i = 0; i < E.filecap; i++) {
+		efile * F = E.file[i];
+		if (F == NULL) continue;
+		char * name = F->filename ? F->filename : "[No Name]";
+		int len = strlen(name);
+		for (int k = 0; k < len; k++) SW.names[off + k] = tolower((unsigned char) name[k]);
+		SW.names[off + len] = '\0';
+		SW.offsets[SW.numnames] = off;
+		SW.lengths[SW.numnames] = len;
+		SW.handles[SW.numnames] = F->index;
+		SW.cand[SW.numcand++] = SW.numnames;
+		SW.numnames++;
+		off += len + 1;
+	}
+}
+
+void editorSwitcherClose() {
+	free(SW.names);
+	free(SW.offsets);
+	free(SW.lengths);
+	free(SW.handles);
+	free(SW.cand);
+	E.prompthint[0] = '\0';
+}
+
+void editorSwitcherUpdate(char * query) {
+	char q[sizeof(SW.query)];
+	int qlen = 0;
+	while (query[qlen] && qlen < (int) sizeof(q) - 1) {
+		q[qlen] = tolower((unsigned char) query[qlen]);
+		qlen++;
+	}
+	q[qlen] = '\0';
+
+	/* a longer query can only match a subset of the previous candidates */
+	if (strncmp(q, SW.query, strlen(SW.query))) {
+		SW.numcand = SW.numnames;
+		for (int i = 0; i < SW.numnames; i++) SW.cand[i] = i;
+	}
+	memcpy(SW.query, q, qlen + 1);
+
+	int numcand = 0;
+	SW.numtop = 0;
+	for (int c = 0; c < SW.numcand; c++) {
+		int i = SW.cand[c];
+		int score = editorFuzzyScore(&SW.names[SW.offsets[i]], SW.lengths[i], q, qlen);
+		if (score < 0) continue;
+		SW.cand[numcand++] = i;
+
+		int t = SW.numtop;
+		if (t == KILO_SWITCH_TOP) {
+			if (score <= SW.topscore[t - 1]) continue;
+			t--;
+		} else {
+			SW.numtop++;
+		}
+		while (t > 0 && SW.topscore[t - 1] < score) {
+			SW.top[t] = SW.top[t - 1];
+			SW.topscore[t] = SW.topscore[t - 1];
+			t--;
+		}
+		SW.top[t] = i;
+		SW.topscore[t] = score;
+	}
+	SW.numcand = numcand;
+	SW.selected = 0;
+}
+
+void editorSwitcherHint() {
+	int len = snprintf(E.prompthint, sizeof(E.prompthint), "  (%d)", SW.numcand);
+	for (int t = 0; t < SW.numtop && len < (int) sizeof(E.prompthint); t++) {
+		efile * F = E.file[SW.handles[SW.top[t]]];
+		char * name = F->filename ? F->filename : "[No Name]";
+		char * base = strrchr(name, '/');
+		len += snprintf(&E.prompthint[len], sizeof(E.prompthint) - len, (t == SW.selected) ? " [%s]" : " %s", base ? base + 1 : name);
+	}
+}
+
+void editorSwitcherCallback(char * query, int key) {
+	if (key == '\r') {
+		if (SW.numtop > 0) editorSwitchFile(SW.handles[SW.top[SW.selected]]);
+		return;
+	} else if (key == '\x1b') {
+		return;
+	} else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
+		if (SW.numtop > 0) SW.selected = (SW.selected + 1) % SW.numtop;
+	} else if (key == ARROW_LEFT || key == ARROW_UP) {
+		if (SW.numtop > 0) SW.selected = (SW.selected + SW.numtop - 1) % SW.numtop;
+	} else {
+		editorSwitcherUpdate(query);
+	}
+	editorSwitcherHint();
+}
+
+void editorSwitchBuffer() {
+	editorSwitcherOpen();
+	editorSwitcherUpdate("");
+	editorSwitcherHint();
+	char * query = editorPrompt("Switch to: %s", editorSwitcherCallback);
+	free(query);
+	editorSwitcherClose();
+}
+
+/*** input ***/
+
+/* empty says whether Enter may accept an empty reply */
+char * editorPromptReply(char * prompt, void (* callback)(char *, int), int empty) {
+	size_t bufsize = 128;
+	char * buf = malloc(bufsize);
+	
+	size_t buflen = 0;
+	buf[0] = '\0';
+
+	while (1) {
+		editorSetStatusMessage(prompt, buf);
+		editorRefreshScreen();
+
+		int c = editorReadKey();
+		if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {		
+			if (buflen != 0) buf[--buflen] = '\0';
+		} else if (c == '\x1b') {
+			editorSetStatusMessage("");
+			if (callback) callback(buf, c);
+			free(buf);
+			return NULL;
+		} else if (c == '\r') {
+			if (buflen != 0 || empty) {
+				editorSetStatusMessage("");
+				if (callback) callback(buf, c);
+				return buf;
+			}
+		} else if (!iscntrl(c) && c < 256) {
+			if (buflen == bufsize - 1) {
+				bufsize *= 2;
+				buf = realloc(buf, bufsize);
+			}
+			buf[buflen++] = c;
+			buf[buflen] = '\0';
+		}
+
+		if (callback) callback(buf, c);
+	}
+}
+
+char * editorPrompt(char * prompt, void (* callback)(char *, int)) {
+	return editorPromptReply(prompt, callback, 0);
+}
+
+/* Ctrl-X prefixes the pane and fold commands, as in Emacs */
+void editorPrefixCommand() {
+	editorSetStatusMessage("Ctrl-X: 2/3 split, o other, 0 close, 1 only, f/u fold, m match, b block, a align, c column");
+	editorRefreshScreen();
+	int c = editorReadKey();
+	editorSetStatusMessage("");
+	switch (c) {
+		case '2': editorPaneSplit('h'); break;
+		case '3': editorPaneSplit('v'); break;
+		case 'o': editorPaneNext(); break;
+		case '0': editorPaneClose(); break;
+		case '1': editorPaneOnly(); break;
+		case 'f': editorToggleFold(); break;
+		case 'u': editorUnfoldAll(E.file[E.currentfile]); break;
+		case 'm': editorGotoBracket(0); break;
+		case 'b': editorGotoBracket(1); break;
+		case 'a': editorToggleColumns(); break;
+		case 'c': editorGotoColumn(); break;
+	}
+}
+
+/* keys that only move around or leave the buffer alone, the rest are
+ * refused for files opened in the pager */
+int editorIsEdit(int c) {
+	switch (c) {
+		case CTRL_KEY('q'):
+		case CTRL_KEY('o'):
+		case CTRL_KEY('n'):
+		case CTRL_KEY('p'):
+		case CTRL_KEY('f'):
+		case CTRL_KEY('c'):
+		case CTRL_KEY('t'):
+		case CTRL_KEY('e'):
+		case CTRL_KEY('g'):
+		case CTRL_KEY('b'):
+		case CTRL_KEY('w'):
+		case CTRL_KEY('l'):
+		case CTRL_KEY('x'):
+		case '\x1b':
+		case PAGE_UP:
+		case PAGE_DOWN:
+		case ARROW_UP:
+		case ARROW_DOWN:
+		case ARROW_LEFT:
+		case ARROW_RIGHT:
+		case SHIFT_ARROW_UP:
+		case SHIFT_ARROW_DOWN:
+		case SHIFT_ARROW_LEFT:
+		case SHIFT_ARROW_RIGHT:
+		case HOME_KEY:
+		case END_KEY:
+		case SHIFT_TAB:
+			return 0;
+	}
+	return 1;
+}
+
+void editorProcessKeypress() {
+	efile * F = E.file[E.currentfile];
+	
 	static int quit_times = KILO_QUIT_TIMES;
 	int c = editorReadKey();
+	unsigned long start = editorStatStart();
+
+	if (F->source && c == '\r') {
+		editorGrepJump(F);
+		editorStatEnd(STAT_KEYPRESS, start);
+		return;
+	}
+	if ((F->pager || F->hex || F->source) && editorIsEdit(c)) {
+		editorSetStatusMessage("Read-only buffer, editing is disabled");
+		editorStatEnd(STAT_KEYPRESS, start);
+		return;
+	}
+
+	if (CO.active && c != CTRL_KEY('y')) editorCompletionClear();
 
 	switch (c) {
 		case '\r':
-			editorInsertNewline();
+			editorInsertNewline(F);
 			break;
 
 		case CTRL_KEY('q'):
 			if (F->dirty && quit_times > 0) {
 				editorSetStatusMessage("WARNING!!! File has unsaved changes. Press Ctrl-Q %d more times to quit.", quit_times);
 				quit_times--;
+				editorStatEnd(STAT_KEYPRESS, start);
 				return;
 			}
 			if (E.numfiles == 1) {
+				while (E.numsaving > 0) editorLoopRun(-1);
 				write(STDOUT_FILENO, "\x1b[2J", 4);
 				write(STDOUT_FILENO, "\x1b[H", 3);
 				exit(0);
@@ -1001,16 +1645,20 @@ void editorProcessKeypress() {
 			editorNewFile();
 			break;
 						
+		case CTRL_KEY('p'):
+			editorSwitchBuffer();
+			break;
+
 		case CTRL_KEY('f'):
 			editorFind();
 			break;
 		
 		case CTRL_KEY('d'):
-			editorDuplicateRow();
+			editorDuplicateRow(F);
 			break;
 		
 		case CTRL_KEY('k'):
-			editorDeleteRow();
+			editorDeleteRow(F);
 			break;
 			
 		case CTRL_KEY('c'):
@@ -1024,27 +1672,59 @@ void editorProcessKeypress() {
 		case PAGE_UP:
 		case PAGE_DOWN:
 			{
-				if (c == PAGE_UP) {
-					F->cy = F->rowoff;
-				} else if (c == PAGE_DOWN) {
-					F->cy = F->rowoff + E.screenrows - 1;
-					if (F->cy > F->numrows) F->cy = F->numrows;
-				}
-
-				int times = E.screenrows;
-				while (times--) editorMoveCursor(c == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+				/* a screen past the edge of the viewport, as repeated arrows would */
+				int rows = E.pane[E.activepane].rows;
+				int top = editorFoldVisible(F, F->rowoff);
+				if (c == PAGE_UP) editorSetCursor(F, editorFoldRow(F, top - rows), F->cx);
+				else editorSetCursor(F, editorFoldRow(F, top + 2 * rows - 1), F->cx);
 			}
 			break;
 
 		case BACKSPACE:
 		case CTRL_KEY('h'):
 		case DEL_KEY:
-			if (c == DEL_KEY) editorMoveCursor(ARROW_RIGHT);
-			editorDelChar();
+			if (c == DEL_KEY) editorMoveCursor(F, ARROW_RIGHT);
+			editorDelChar(F);
 			break;
 
-		case CTRL_KEY('l'):
 		case '\x1b':
+			if (F->loader) editorLoadAbort(F);
+			break;
+
+		case CTRL_KEY('t'):
+			ST.overlay = !ST.overlay;
+			if (ST.overlay) ST.enabled = 1;
+			break;
+
+		case CTRL_KEY('e'):
+			editorToggleFollow();
+			break;
+
+		case CTRL_KEY('g'):
+			editorGoto();
+			break;
+
+		case CTRL_KEY('r'):
+			editorReplace();
+			break;
+
+		case CTRL_KEY('w'):
+			editorGrepView();
+			break;
+
+		case CTRL_KEY('b'):
+			editorBookmark();
+			break;
+
+		case CTRL_KEY('x'):
+			editorPrefixCommand();
+			break;
+
+		case CTRL_KEY('y'):
+			editorComplete();
+			break;
+
+		case CTRL_KEY('l'):
 			break;
 
 		case ARROW_UP:
@@ -1057,7 +1737,7 @@ void editorProcessKeypress() {
 		case SHIFT_ARROW_RIGHT:
 		case HOME_KEY:
 		case END_KEY:
-			editorMoveCursor(c);
+			editorMoveCursor(F, c);
 			break;
 
 		case SHIFT_TAB:
@@ -1065,117 +1745,332 @@ void editorProcessKeypress() {
 			break;
 
 		default:
-		editorInsertChar(c);
+		editorInsertChar(F, c);
 		break;
 	}
 
 	quit_times = KILO_QUIT_TIMES;
+	editorStatEnd(STAT_KEYPRESS, start);
 }
 
 /*** output ***/
 
+int editorSyntaxToColor(int hl) {
+	switch (hl) {
+		case HL_COMMENT:
+		case HL_MLCOMMENT: return 36;
+		case HL_KEYWORD1: return 33;
+		case HL_KEYWORD2: return 32;
+		case HL_STRING: return 35;
+		case HL_NUMBER: return 31;
+		case HL_MATCH: return 34;
+		default: return 37;
+	}
+}
+
+/* digits in the line numbers, a grep view numbers its rows as in the source */
+int editorGutterWidth(efile * F) {
+	return (int) ceil(log10((F->source ? F->source->numrows : F->numrows) + 1));
+}
+
 void editorScroll() {
-	efile * F = &E.file[E.currentfile];
-	int numlen = (int) ceil(log10(F->numrows + 1));	
+	efile * F = E.file[E.currentfile];
+	struct editorPane * P = &E.pane[E.activepane];
+	int numlen = editorGutterWidth(F);	
 	F->rx = 0;
-	if (F->cy < F->numrows) {
-		F->rx = editorRowCxToRx(&F->row[F->cy], F->cx);
+	editorColumnsSample(F, F->rowoff);
+	if (F->cy < F->numrows && !F->hex) {
+		erow * row = editorFileRow(F, F->cy);
+		if (F->columns) F->rx = editorColumnsRx(F, row, editorRowCxToRender(row, F->cx));
+		else F->rx = editorRowCxToRx(row, F->cx);
 	}
 
-	if (F->cy < F->rowoff) {
+	/* rows are counted on screen, where a fold takes one */
+	int vcy = editorFoldVisible(F, F->cy);
+	int vtop = editorFoldVisible(F, F->rowoff);
+	if (vcy < vtop) {
 		F->rowoff = F->cy;
 	}
-	if (F->cy >= F->rowoff + E.screenrows) {
-		F->rowoff = F->cy - E.screenrows + 1;
+	if (vcy >= vtop + P->rows) {
+		F->rowoff = editorFoldRow(F, vcy - P->rows + 1);
 	}
 	if (F->rx < F->coloff) {
 		F->coloff = F->rx;
 	}
-	if (F->rx >= F->coloff + E.screencols - (numlen + 2)) {
-		F->coloff = F->rx - E.screencols + numlen + 3;
+	if (F->rx >= F->coloff + P->cols - (numlen + 2)) {
+		F->coloff = F->rx - P->cols + numlen + 3;
+	}
+}
+
+void editorPad(struct abuf * ab, int len) {
+	while (len-- > 0) abAppend(ab, " ", 1);
+}
+
+/* screen column of byte i of a hex row: the offset, then two groups of
+ * KILO_HEX_WIDTH / 2 bytes */
+int editorHexColumn(efile * F, int i) {
+	int digits = 8;
+	while (digits < 16 && ((unsigned long long) F->size - 1) >> (4 * digits)) digits++;
+	return digits + 2 + 3 * i + (i >= KILO_HEX_WIDTH / 2);
+}
+
+/* rows of a hex view laid out from the mapped bytes: offset, hex and the
+ * printable bytes, with a search match marked in both panels and the
+ * cursor's byte underlined beside the hex */
+void editorDrawHexRows(struct abuf * lines, struct editorPane * P) {
+	efile * F = E.file[P->file];
+	editorHexCheck(F);
+	int digits = editorHexColumn(F, 0) - 2;
+	off_t mstart = (E.hexfile == F->index) ? E.hexmatch : -1;
+	off_t mend = mstart + E.hexmatchlen;
+	for (int y = 0; y < P->rows; y++) {
+		struct abuf * ab = &lines[P->top + y];
+		int filerow = P->rowoff + y;
+		if (filerow >= F->numrows) {
+			if (P->cols > 0) abAppend(ab, "~", 1);
+			editorPad(ab, P->cols - 1);
+			continue;
+		}
+		int len;
+		unsigned char * bytes = editorHexRow(F, filerow, &len);
+		off_t base = (off_t) filerow * KILO_HEX_WIDTH;
+
+		char line[128];
+		char mark[128] = {0};
+		int n = snprintf(line, sizeof(line), "%0*llx  ", digits, (long long) base);
+		for (int i = 0; i < KILO_HEX_WIDTH; i++) {
+			int col = editorHexColumn(F, i);
+			while (n < col) line[n++] = ' ';
+			if (i < len) n += snprintf(&line[n], sizeof(line) - n, "%02x", bytes[i]);
+			else n += snprintf(&line[n], sizeof(line) - n, "  ");
+			if (base + i >= mstart && base + i < mend) mark[col] = mark[col + 1] = 1;
+		}
+		n += snprintf(&line[n], sizeof(line) - n, "  |");
+		for (int i = 0; i < len; i++) {
+			if (base + i >= mstart && base + i < mend) mark[n] = 1;
+			if (filerow == P->cy && i == P->cx) mark[n] |= 2;
+			line[n++] = isprint(bytes[i]) ? bytes[i] : '.';
+		}
+		line[n++] = '|';
+
+		if (n > P->cols) n = P->cols;
+		for (int i = 0; i < n;) {
+			int j = i;
+			while (j < n && mark[j] == mark[i]) j++;
+			if (mark[i] & 1) abAppend(ab, "\x1b[7m", 4);
+			if (mark[i] & 2) abAppend(ab, "\x1b[4m", 4);
+			abAppend(ab, &line[i], j - i);
+			if (mark[i]) abAppend(ab, "\x1b[m", 3);
+			i = j;
+		}
+		editorPad(ab, P->cols - n);
+	}
+}
+
+/* the cluster of row at render offset j up to next in its highlight
+ * colour; controls and bytes that are not UTF-8 show as a marked symbol */
+void editorDrawChars(struct abuf * ab, erow * row, int j, int next, int * current_color) {
+	char * c = row->render;
+	unsigned char b = c[j];
+	int cp = b;
+	if (b >= 0x80) editorUtf8Decode(&c[j], row->rsize - j, &cp);
+	if (cp < 0x20 || (cp >= 0x7f && cp < 0xa0)) {
+		char sym = (cp >= 0 && cp <= 26) ? '@' + cp : '?';
+		abAppend(ab, "\x1b[7m", 4);
+		abAppend(ab, &sym, 1);
+		abAppend(ab, "\x1b[m", 3);
+		if (*current_color != -1) {
+			char buf[16];
+			int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", *current_color);
+			abAppend(ab, buf, clen);
+		}
+	} else if (row->hl[j] == HL_NORMAL) {
+		if (*current_color != -1) {
+			abAppend(ab, "\x1b[39m", 5);
+			*current_color = -1;
+		}
+		abAppend(ab, &c[j], next - j);
+	} else {
+		int color = editorSyntaxToColor(row->hl[j]);
+		if (color != *current_color) {
+			*current_color = color;
+			char buf[16];
+			int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
+			abAppend(ab, buf, clen);
+		}
+		abAppend(ab, &c[j], next - j);
+	}
+}
+
+/* a row of delimited data with each field padded out to its column and a
+ * rule where the separators are; x counts screen columns from the row's
+ * start and out how far the line has been written, returned relative to
+ * coloff for the caller to pad */
+int editorDrawFields(struct abuf * ab, efile * F, erow * row, int filerow, int coloff, int textcols) {
+	int * fields = editorRowFields(row, editorFieldSeparator(F->syntax));
+	int selbegin = (filerow == F->beginsel[0]) ? editorRowCxToRender(row, F->beginsel[1]) : (filerow > F->beginsel[0] ? 0 : INT_MAX);
+	int selend = (filerow == F->endsel[0]) ? editorRowCxToRender(row, F->endsel[1]) : (filerow < F->endsel[0] ? INT_MAX : 0);
+	if (F->beginsel[0] == -1) selbegin = selend = 0;
+	int current_color = -1, insel = 0;
+	int out = coloff, right = coloff + textcols;
+	int prevend = 0;
+	for (int i = 0; i < fields[0] && out < right; i++) {
+		int x = editorColumnStart(F, i, prevend);
+		int rule = x - KILO_COLUMN_GAP + 1;
+		if (i > 0 && rule >= out && rule < right) {
+			editorPad(ab, rule - out);
+			abAppend(ab, "\x1b[2m|\x1b[22m", 10);
+			out = rule + 1;
+		}
+		int rs = fields[1 + 2 * i], re = fields[2 + 2 * i];
+		int base = x - editorRowRenderToRx(row, rs);
+		for (int j = rs; j < re;) {
+			int next = j + 1, width = 1;
+			if (row->rcol) {
+				next = editorRowClusterEnd(row, j);
+				width = row->rcol[next] - row->rcol[j];
+			}
+			int cx = base + editorRowRenderToRx(row, j);
+			if (cx + width > right) {
+				out = right;
+				break;
+			}
+			if (cx >= out) {
+				int sel = (j >= selbegin && j < selend);
+				editorPad(ab, cx - out);
+				if (sel != insel) abAppend(ab, sel ? "\x1b[7m" : "\x1b[27m", sel ? 4 : 5);
+				insel = sel;
+				editorDrawChars(ab, row, j, next, &current_color);
+				out = cx + width;
+			}
+			j = next;
+		}
+		prevend = x + editorRowRenderToRx(row, re) - editorRowRenderToRx(row, rs);
 	}
+	abAppend(ab, "\x1b[m", 3);
+	abAppend(ab, "\x1b[39m", 5);
+	return out - coloff;
 }
 
-void editorDrawRows(struct abuf *ab) {
-	efile * F = &E.file[E.currentfile];	
-	int numlen = (int) ceil(log10(F->numrows + 1));
-	char * linenum = malloc(numlen + 1);
-	for (int y = 0; y < E.screenrows; y++) {
-		int filerow = y + F->rowoff;
+/* rows of a pane appended to the screen lines it covers, each padded to
+ * the pane's width so the panes beside it line up */
+void editorDrawRows(struct abuf * lines, struct editorPane * P) {
+	efile * F = E.file[P->file];
+	if (F->hex) {
+		editorDrawHexRows(lines, P);
+		return;
+	}
+	int numlen = editorGutterWidth(F);
+	int textcols = P->cols - (numlen + 2);
+	char linenum[16];
+	editorColumnsSample(F, P->rowoff);
+	int vtop = editorFoldVisible(F, P->rowoff);
+	for (int y = 0; y < P->rows; y++) {
+		struct abuf * ab = &lines[P->top + y];
+		int filerow = editorFoldRow(F, vtop + y);
 		if (filerow >= F->numrows) {
-			if (F->numrows == 0 && y == E.screenrows / 3) {
+			int width = 1;
+			if (F->numrows == 0 && y == P->rows / 3) {
 				char welcome[80];
 				int welcomelen = snprintf(welcome, sizeof(welcome), "Kilo editor -- version %s", KILO_VERSION);
-				if (welcomelen > E.screencols) welcomelen = E.screencols;
-				int padding = (E.screencols - welcomelen) / 2;
+				if (welcomelen > P->cols) welcomelen = P->cols;
+				int padding = (P->cols - welcomelen) / 2;
+				width = padding + welcomelen;
 				if (padding) {
 					abAppend(ab, "~", 1);
 					padding--;
 				}
-				while (padding--) abAppend(ab, " ", 1);
+				editorPad(ab, padding);
 				abAppend(ab, welcome, welcomelen);
-			} else {
+			} else if (P->cols > 0) {
 				abAppend(ab, "~", 1);
 			}
+			editorPad(ab, P->cols - width);
 		} else {
-			snprintf(linenum, numlen + 3, "%*d| ", numlen, filerow + 1);
-			abAppend(ab, linenum, numlen + 3);
-			int len = F->row[filerow].rsize - F->coloff;
-			if (len < 0) len = 0;
-			if (len > E.screencols - (numlen + 2)) len = E.screencols - (numlen + 2);
-			char * c = &F->row[filerow].render[F->coloff];
-			unsigned char * hl = &F->row[filerow].hl[F->coloff];
+			/* a folded block is marked in the gutter of the row left showing */
+			int numwidth = snprintf(linenum, sizeof(linenum), "%*d%c ", numlen, (F->source ? F->refs[filerow] : filerow) + 1, editorFoldAt(F, filerow) ? '+' : '|');
+			if (numwidth > P->cols) numwidth = P->cols;
+			abAppend(ab, linenum, numwidth);
+			erow * row = editorFileRow(F, filerow);
+			if (F->columns) {
+				int col = editorDrawFields(ab, F, row, filerow, P->coloff, textcols);
+				editorPad(ab, P->cols - numwidth - col);
+				continue;
+			}
 			int current_color = -1;
-			if (filerow > F->beginsel[0] && filerow <= F->endsel[0]) abAppend(ab, "\x1b[7m", 4);
-			for (int j = 0; j < len; j++) {
-				if (filerow == F->beginsel[0] && j == editorRowCxToRx(&F->row[filerow], F->beginsel[1]))
-					abAppend(ab, "\x1b[7m", 4);
-				else if (filerow == F->endsel[0] && j == editorRowCxToRx(&F->row[filerow], F->endsel[1]))
-					abAppend(ab, "\x1b[m", 3);
-				if (iscntrl(c[j])) {
-					char sym = (c[j] <= 26) ? '@' + c[j] : '?';
+			/* coloff is a screen column; a wide character cut by the left
+			 * edge leaves blanks for the part still showing */
+			int j = editorRowRxToRender(row, P->coloff);
+			int col = 0;
+			if (j < row->rsize && editorRowRenderToRx(row, j) < P->coloff) {
+				j = editorRowClusterEnd(row, j);
+				col = editorRowRenderToRx(row, j) - P->coloff;
+				if (col > textcols) col = textcols;
+				if (col < 0) col = 0;
+				editorPad(ab, col);
+			}
+			/* the bracket pair around the cursor is underlined */
+			int match[2] = {-1, -1};
+			for (int k = 0; k < 2 && F->index == E.matchfile; k++) {
+				if (E.matchrow[k] == filerow) match[k] = E.matchcol[k];
+			}
+			int selbegin = (filerow == F->beginsel[0]) ? editorRowCxToRender(row, F->beginsel[1]) : -1;
+			int selend = (filerow == F->endsel[0]) ? editorRowCxToRender(row, F->endsel[1]) : -1;
+			if ((filerow > F->beginsel[0] || (selbegin != -1 && selbegin < j)) &&
+				(filerow < F->endsel[0] || (selend != -1 && selend > j))) abAppend(ab, "\x1b[7m", 4);
+			while (j < row->rsize) {
+				int next = j + 1, width = 1;
+				if (row->rcol) {
+					next = editorRowClusterEnd(row, j);
+					width = row->rcol[next] - row->rcol[j];
+				}
+				if (col + width > textcols) break;
+				if (j == selbegin)
 					abAppend(ab, "\x1b[7m", 4);
-					abAppend(ab, &sym, 1);
+				else if (j == selend)
 					abAppend(ab, "\x1b[m", 3);
-					if (current_color != -1) {
-						char buf[16];
-						int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", current_color);
-						abAppend(ab, buf, clen);
-					}
-				} else if (hl[j] == HL_NORMAL) {
-					if (current_color != -1) {
-						abAppend(ab, "\x1b[39m", 5);
-						current_color = -1;
-					}
-					abAppend(ab, &c[j], 1);
-				} else {
-					int color = editorSyntaxToColor(hl[j]);
-					if (color != current_color) {
-						current_color = color;
-						char buf[16];
-						int clen = snprintf(buf, sizeof(buf), "\x1b[%dm", color);
-						abAppend(ab, buf, clen);
-					}
-					abAppend(ab, &c[j], 1);
-				}
+				int under = (j == match[0] || j == match[1]);
+				if (under) abAppend(ab, "\x1b[1;4m", 6);
+				editorDrawChars(ab, row, j, next, &current_color);
+				if (under) abAppend(ab, "\x1b[22;24m", 8);
+				col += width;
+				j = next;
 			}
 			abAppend(ab, "\x1b[m", 3);
 			abAppend(ab, "\x1b[39m", 5);
+			editorPad(ab, P->cols - numwidth - col);
 		}
-		abAppend(ab, "\x1b[K\r\n", 5);		
 	}
 }
 
-void editorDrawStatusBar(struct abuf * ab) {
-	efile * F = &E.file[E.currentfile];
-	abAppend(ab, "\x1b[7m", 4);
+void editorDrawStatusBar(struct abuf * ab, struct editorPane * P) {
+	efile * F = E.file[P->file];
+	/* panes without the focus have a dimmed bar */
+	if (P == &E.pane[E.activepane]) abAppend(ab, "\x1b[7m", 4);
+	else abAppend(ab, "\x1b[2;7m", 6);
 	char status[80], rstatus[80];
-	int len = snprintf(status, sizeof(status), "%.20s file (%d/%d) %s", F->filename ? F->filename : "[No Name]", E.currentfile + 1, E.numfiles, F->dirty ? "(modified)" : "");
-	int rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d", F->syntax ? F->syntax->filetype : "no ft", F->cy + 1, F->numrows);
-	if (len > E.screencols) len = E.screencols;
+	char progress[32] = "";
+	if (F->loader) snprintf(progress, sizeof(progress), "[loading %d%%, ESC cancels]", editorLoadProgress(F));
+	else if (F->follow) snprintf(progress, sizeof(progress), "[following]");
+	else if (F->pager) {
+		int percent = editorPagerProgress(F);
+		if (percent < 100) snprintf(progress, sizeof(progress), "[indexing %d%%]", percent);
+		else snprintf(progress, sizeof(progress), "[read-only]");
+	}
+	else if (F->hex || F->source) snprintf(progress, sizeof(progress), "[read-only]");
+	int len = snprintf(status, sizeof(status), "%.20s file #%d (%d open) %s %s", F->filename ? F->filename : "[No Name]", F->index + 1, E.numfiles, F->dirty ? "(modified)" : "", progress);
+	int rlen;
+	if (F->hex) rlen = snprintf(rstatus, sizeof(rstatus), "hex | %llx/%llx", (long long) P->cy * KILO_HEX_WIDTH + P->cx, (long long) F->size);
+	else if (F->columns && P->cy < F->numrows) {
+		erow * row = editorFileRow(F, P->cy);
+		int field = editorColumnsField(F, row, editorRowCxToRender(row, P->cx));
+		rlen = snprintf(rstatus, sizeof(rstatus), "%s col %d | %d/%d", F->syntax->filetype, field + 1, P->cy + 1, F->numrows);
+	}
+	else rlen = snprintf(rstatus, sizeof(rstatus), "%s | %d/%d", F->syntax ? F->syntax->filetype : "no ft", P->cy + 1, F->numrows);
+	if (len > P->cols) len = P->cols;
 	abAppend(ab, status, len);
-	while (len < E.screencols) {
-		if (E.screencols - len == rlen) {
+	while (len < P->cols) {
+		if (P->cols - len == rlen) {
 			abAppend(ab, rstatus, rlen);
 			break;
 		} else {
@@ -1183,36 +2078,151 @@ void editorDrawStatusBar(struct abuf * ab) {
 			len++;
 		}
 	}
-	abAppend(ab, "\x1b[m\r\n", 5);
+	abAppend(ab, "\x1b[m", 3);
+}
+
+/* splits draw their children in screen order, so every line is appended
+ * to from left to right */
+void editorDrawPane(struct abuf * lines, int p) {
+	struct editorPane * P = &E.pane[p];
+	if (P->split) {
+		editorDrawPane(lines, P->child[0]);
+		if (P->split == 'v') {
+			for (int y = 0; y <= P->rows; y++) abAppend(&lines[P->top + y], "|", 1);
+		}
+		editorDrawPane(lines, P->child[1]);
+		return;
+	}
+	if (P->rows < 0) return;
+	editorDrawRows(lines, P);
+	editorDrawStatusBar(&lines[P->top + P->rows], P);
 }
 
 void editorDrawMessageBar(struct abuf * ab) {
 	abAppend(ab, "\x1b[K", 3);
 	int msglen = strlen(E.statusmsg);
 	if (msglen > E.screencols) msglen = E.screencols;
-	if (msglen && time(NULL) - E.statusmsg_time < 5) abAppend(ab, E.statusmsg, msglen);
+	if (msglen && time(NULL) - E.statusmsg_time < KILO_STATUS_TIMEOUT) {
+		abAppend(ab, E.statusmsg, msglen);
+		int hintlen = strlen(E.prompthint);
+		if (hintlen > E.screencols - msglen) hintlen = E.screencols - msglen;
+		if (hintlen > 0) abAppend(ab, E.prompthint, hintlen);
+	}
 }
 
+void editorDrawStatsOverlay(struct abuf * ab) {
+	char line[80];
+	int width = 56;
+	int col = E.screencols - width + 1;
+	if (col < 1) col = 1;
+
+	for (int i = 0; i <= STAT_NUM + 1 && i < E.screenrows; i++) {
+		int len = snprintf(line, sizeof(line), "\x1b[%d;%dH\x1b[7m", i + 1, col);
+		abAppend(ab, line, len);
+		if (i == 0) len = snprintf(line, sizeof(line), "%-12s %9s %9s %9s %8s", "stats", "p50", "p99", "max", "count");
+		else if (i <= STAT_NUM) len = editorStatLine(line, sizeof(line), i - 1);
+		else len = snprintf(line, sizeof(line), "written %lub  rehl %lu rows  frames %lu", ST.byteswritten, ST.rowshighlighted, ST.frames);
+		if (len > width) len = width;
+		if (len > E.screencols) len = E.screencols;
+		abAppend(ab, line, len);
+		while (len++ < width && len <= E.screencols) abAppend(ab, " ", 1);
+		abAppend(ab, "\x1b[m", 3);
+	}
+}
+
+/* the panes are composed into one frame of screen lines, and only lines
+ * that differ from the last frame are written, so an edit repaints the
+ * rows it touched in every pane showing them */
 void editorRefreshScreen() {
-	efile * F = &E.file[E.currentfile];
+	efile * F = E.file[E.currentfile];
+	struct editorPane * P = &E.pane[E.activepane];
 	struct abuf ab = ABUF_INIT;
-	getWindowSize(&E.screenrows, &E.screencols, 0);
-	
 	editorScroll();
+	editorPaneSave();
+	E.matchfile = -1;
+	int bracket = editorCursorBracket(F);
+	if (bracket != -1 && editorMatchBracket(F, F->cy, bracket, &E.matchrow[1], &E.matchcol[1]) == 0) {
+		E.matchfile = F->index;
+		E.matchrow[0] = F->cy;
+		E.matchcol[0] = bracket;
+	}
 	abAppend(&ab, "\x1b[?25l", 6);
-	abAppend(&ab, "\x1b[H", 3);
-	editorDrawRows(&ab);
-	editorDrawStatusBar(&ab);
-	editorDrawMessageBar(&ab);
+	if (E.repaint) abAppend(&ab, "\x1b[2J", 4);
 
+	int numlines = E.screenrows + 2;
+	struct abuf * lines = calloc(numlines, sizeof(struct abuf));
+	unsigned long start = editorStatStart();
+	editorDrawPane(lines, E.rootpane);
+	editorStatEnd(STAT_DRAWROWS, start);
+	editorDrawMessageBar(&lines[numlines - 1]);
+
+	/* the overlay covers lines that would otherwise look unchanged */
+	int all = E.repaint || ST.overlay || E.overlaid || numlines != E.framelines;
 	char buf[32];
-	int numlen = (int) ceil(log10(F->numrows + 1));
-	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (F->cy - F->rowoff) + 1, (F->rx - F->coloff) + numlen + 3);
+	for (int y = 0; y < numlines; y++) {
+		struct abuf * line = &lines[y];
+		if (!all && line->len == E.frame[y].len && (line->len == 0 || !memcmp(line->b, E.frame[y].b, line->len))) continue;
+		int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H\x1b[K", y + 1);
+		abAppend(&ab, buf, len);
+		abAppend(&ab, line->b, line->len);
+	}
+	for (int y = 0; y < E.framelines; y++) abFree(&E.frame[y]);
+	free(E.frame);
+	E.frame = lines;
+	E.framelines = numlines;
+	E.overlaid = ST.overlay;
+	if (ST.overlay) editorDrawStatsOverlay(&ab);
+
+	int x = F->hex ? editorHexColumn(F, F->cx) : (F->rx - F->coloff) + editorGutterWidth(F) + 2;
+	int y = editorFoldVisible(F, F->cy) - editorFoldVisible(F, F->rowoff);
+	snprintf(buf, sizeof(buf), "\x1b[%d;%dH", P->top + y + 1, P->left + x + 1);
 	abAppend(&ab, buf, strlen(buf));
 	abAppend(&ab, "\x1b[?25h", 6);
 
-	write(STDOUT_FILENO, ab.b, ab.len);
+	start = editorStatStart();
+	editorWrite(ab.b, ab.len);
+	if (start) {
+		unsigned long now = editorNanos();
+		editorStatRecord(STAT_WRITE, now - start);
+		if (ST.keytime) editorStatRecord(STAT_LATENCY, now - ST.keytime);
+		ST.keytime = 0;
+		ST.byteswritten += ab.len;
+		ST.frames++;
+	}
 	abFree(&ab);
+	E.redraw = 0;
+	E.repaint = 0;
+	E.lastframe = editorMonotonicMs();
+}
+
+void editorFrameDue(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	E.frametimer = 0;
+}
+
+/* background updates such as followed files are painted at most once per frame */
+void editorRedraw() {
+	long wait = E.lastframe + KILO_FRAME_MS - editorMonotonicMs();
+	if (wait <= 0) {
+		editorRefreshScreen();
+	} else if (!E.frametimer) {
+		E.frametimer = 1;
+		editorLoopTimer(wait, editorFrameDue, NULL);
+	}
+}
+
+/* repaint once the message bar has gone stale, later messages push the timer back */
+void editorStatusExpired(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	long left = E.statusmsg_time + KILO_STATUS_TIMEOUT - time(NULL);
+	if (left > 0) {
+		editorLoopTimer(left * 1000, editorStatusExpired, NULL);
+		return;
+	}
+	E.statustimer = 0;
+	E.redraw = 1;
 }
 
 void editorSetStatusMessage(const char *fmt, ...) {
@@ -1221,30 +2231,102 @@ void editorSetStatusMessage(const char *fmt, ...) {
 	vsnprintf(E.statusmsg, sizeof(E.statusmsg), fmt, ap);
 	va_end(ap);
 	E.statusmsg_time = time(NULL);
+	if (!E.statustimer) {
+		E.statustimer = 1;
+		editorLoopTimer(KILO_STATUS_TIMEOUT * 1000, editorStatusExpired, NULL);
+	}
 }
 
 /*** init ***/
 
-void initEditor() {
+void initWorkspace() {
 	E.numfiles = 0;
 	E.currentfile = -1;
+	E.file = NULL;
+	E.filecap = 0;
+	E.numfree = 0;
+	E.freefiles = NULL;
+	E.numresident = 0;
+	E.lruhead = -1;
+	E.lrutail = -1;
+	E.numloading = 0;
+	E.numsaving = 0;
+}
+
+void initEditor() {
+	initWorkspace();
+	editorStatInit();
 	E.clipboard = NULL;
 	E.statusmsg[0] = '\0';
+	E.prompthint[0] = '\0';
 	E.statusmsg_time = 0;
+	E.statustimer = 0;
+	E.inputlen = 0;
+	E.inputpos = 0;
+	E.redraw = 0;
+	E.repaint = 0;
+	E.frametimer = 0;
+	E.lastframe = 0;
+	E.inotify = -1;
+	E.followindex = -1;
+	E.pager = 0;
+	E.hex = 0;
+	E.hexfile = -1;
+	E.gotoindex = -1;
+	E.gotoline = 0;
+	E.wordtimer = 0;
+	CO.active = 0;
+	CO.numcand = 0;
+	E.rootpane = E.activepane = editorPaneAlloc();
+	E.frame = NULL;
+	E.framelines = 0;
+	E.overlaid = 0;
+	E.matchfile = -1;
 
 	if (getWindowSize(&E.screenrows, &E.screencols, 1) == -1) die("getWindowSize");
+	editorPaneResize();
 }
 
+#ifndef KILO_HEADLESS
 int main(int argc, char * argv[]) {
 	enableRawMode();
 	initEditor();
-	if (argc >= 2) {
-		editorOpen(argv[1]);
+	if (editorLoopInit(editorWakeReady, NULL) == -1) die("editorLoopInit");
+	editorLoopWatch(STDIN_FILENO, editorInputReady, NULL);
+	editorLoopSignal(SIGWINCH, editorResize, NULL);
+
+	int follow = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "frx")) != -1) {
+		if (opt == 'f') follow = 1;
+		else if (opt == 'r') E.pager = 1;
+		else if (opt == 'x') E.hex = 1;
+	}
+	/* +N anywhere among the arguments opens at line N */
+	int line = 0;
+	char * filename = NULL;
+	for (int i = optind; i < argc; i++) {
+		if (argv[i][0] == '+') {
+			long long n = strtoll(&argv[i][1], NULL, 10);
+			line = (n > INT_MAX) ? INT_MAX : (n < 0) ? 0 : n;
+		} else {
+			filename = argv[i];
+		}
+	}
+	editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-F = find | Ctrl-G = go to | Ctrl-Q = quit");
+	if (filename && editorOpen(filename) == 0) {
+		if (line > 0) editorGotoLine(E.file[E.currentfile], line);
+		if (follow) editorToggleFollow();
 	} else {
-		editorNewFile();
-	}	
-	
-	editorSetStatusMessage("HELP: Ctrl-S = save | Ctrl-F = find | Ctrl-Q = quit");
+		if (E.numfiles == 0) editorNewFile();
+		/* a file that is not there yet is created by the first save */
+		if (filename && access(filename, F_OK) == -1 && errno == ENOENT) {
+			efile * F = E.file[E.currentfile];
+			F->filename = strdup(filename);
+			editorSelectSyntaxHighlight(F);
+			editorSetStatusMessage("New file %s", filename);
+		}
+	}
 
 	while (1) {
 		editorRefreshScreen();
@@ -1253,3 +2335,4 @@ int main(int argc, char * argv[]) {
 	
 	return 0;
 }
+#endif
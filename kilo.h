@@ -8,16 +8,487 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
-#include "hldb.c"
+/*** defines ***/
+
+#define CTRL_KEY(k) ((k) & 0x1F)
+#define SHIFT_KEY(k) ((k) & 0x400)
+#define KILO_TAB_STOP 4
+#define KILO_LOAD_CHUNK (1 << 20)
+#define KILO_LOAD_BATCH 4096
+#define KILO_LOAD_BUDGET 16
+#define KILO_MAX_THREADS 64
+#define KILO_HL_CHUNK_MIN 1024
+#define KILO_BRACKET_BLOCK 64
+#define KILO_WORD_MAX 64
+#define KILO_COMPLETIONS 32
+#define KILO_LOOP_WATCHES 8
+#define KILO_LOOP_ENTRIES 64
+#define KILO_PAGER_STRIDE 1024
+#define KILO_PAGER_SCAN (8 << 20)
+#define KILO_PAGER_BUDGET (32 << 20)
+#define KILO_PAGER_AROUND (64 << 10)
+#define KILO_PAGER_MAXROWS (INT_MAX - KILO_PAGER_STRIDE)
+#define KILO_MAP_GUARDS 16
+#define KILO_HEX_WIDTH 16
+#define KILO_HEX_SNIFF 8192
+#define KILO_COLUMN_SAMPLE 1024
+#define KILO_COLUMN_MAX 256
+#define KILO_COLUMN_WIDTH 32
+#define KILO_COLUMN_GAP 3
+#define KILO_HIST_SUB 8
+#define KILO_HIST_BUCKETS (64 * KILO_HIST_SUB)
+
+#define HL_HIGHLIGHT_NUMBERS (1<<0)
+#define HL_HIGHLIGHT_STRINGS (1<<1)
+#define HL_FOLD_BRACES (1<<2)
+#define HL_CSV (1<<3)
+#define HL_TSV (1<<4)
+
+/*** data ***/
+
+enum editorKey {
+	BACKSPACE = 127,
+	ARROW_LEFT = 0x200,
+	ARROW_RIGHT,
+	ARROW_UP,
+	ARROW_DOWN,
+	DEL_KEY,
+	HOME_KEY,
+	END_KEY,
+	PAGE_UP,
+	PAGE_DOWN,
+	SHIFT_ARROW_LEFT = 0x400,
+	SHIFT_ARROW_RIGHT,
+	SHIFT_ARROW_UP,
+	SHIFT_ARROW_DOWN,
+	SHIFT_TAB
+};
+
+enum editorStat {
+	STAT_READKEY = 0,
+	STAT_KEYPRESS,
+	STAT_HIGHLIGHT,
+	STAT_DRAWROWS,
+	STAT_WRITE,
+	STAT_LATENCY,
+	STAT_OPEN,
+	STAT_FIND,
+	STAT_SAVE,
+	STAT_NUM
+};
+
+enum editorLoopBackend {
+	LOOP_NONE = 0,
+	LOOP_POLL,
+	LOOP_URING
+};
+
+enum editorCodecType {
+	CODEC_NONE = 0,
+	CODEC_GZIP,
+	CODEC_ZSTD
+};
+
+enum editorHighlight {
+	HL_NORMAL = 0,
+	HL_COMMENT,
+	HL_MLCOMMENT,
+	HL_KEYWORD1,
+	HL_KEYWORD2,
+	HL_STRING,
+	HL_NUMBER,
+	HL_MATCH,
+	HL_SEL = 0,
+	HL_UNSEL = 1
+};
+
+struct editorSyntax {
+	char * filetype;
+	char ** filematch;
+	char ** keywords;
+	char * singleline_comment_start;
+	char * multiline_comment_start;
+	char * multiline_comment_end;
+	int flags;
+};
+
+/* bracket depth change over a span of text and the lowest depth reached
+ * on the way; walking it backwards the highest depth is net - low */
+struct editorBracketSum {
+	int net;
+	int low;
+};
+
+typedef struct erow {
+	int idx;
+	int size;
+	int rsize;
+	unsigned int snap;
+	char * chars;
+	char * render;
+	int * rcol;
+	int * fields;
+	unsigned char * hl;
+	int hl_open_comment;
+	struct editorBracketSum brackets;
+} erow;
+
+/* one field of a delimited row: chars [cs, ce) rendered at [rs, re), and
+ * where the field after the separator starts */
+struct editorField {
+	int cs, ce;
+	int rs, re;
+	int next, rnext;
+	int more;
+};
+
+typedef struct erowBatch {
+	erow * rows;
+	int numrows;
+	struct erowBatch * next;
+} erowBatch;
+
+struct editorCodec;
+struct editorCompressor;
+
+struct editorLoader {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int fd;
+	off_t size;
+	off_t loaded;
+	int done;
+	int cancel;
+	int error;
+	int batch;
+	int unterminated;
+	struct editorCodec * codec;
+	erowBatch * head;
+	erowBatch * tail;
+};
+
+struct editorPager;
+struct editorHex;
+struct editorColumns;
+struct editorBrackets;
+struct editorSaver;
+
+struct editorMark {
+	char * name;
+	int line;
+};
+
+/* rows start + 1 to end are hidden under row start; hidden counts the rows
+ * hidden by the folds before this one */
+struct editorFold {
+	int start;
+	int end;
+	int hidden;
+};
+
+struct editorFollow {
+	int fd;
+	int wd;
+	int inotify;
+	int more;
+};
+
+/* one buffer; every libkilo call takes the buffer it works on, the
+ * workspace links are only used by the front-end */
+typedef struct efile {
+	int index;
+	int next, prev;
+	int lrunext, lruprev;
+	int resident;
+	int saving;
+	struct editorSaver * saver;
+	unsigned int snapgen;
+	int cx, cy;
+	int rx;
+	int rowoff;
+	int coloff;
+	int numrows;
+	erow * row;
+	int dirty;
+	int beginsel[2];
+	int endsel[2];
+	int partial;
+	int error;
+	off_t size;
+	int unterminated;
+	int codec;
+	char * filename;
+	struct editorSyntax * syntax;
+	struct editorLoader * loader;
+	struct editorFollow * follow;
+	struct editorPager * pager;
+	struct editorHex * hex;
+	struct editorColumns * columns;
+	struct editorMark * marks;
+	int nummarks;
+	struct editorFold * folds;
+	int numfolds;
+	struct editorBrackets * brackets;
+	int wordrows;
+	struct efile * source;
+	int * refs;
+} efile;
+
+typedef struct hlChunk {
+	efile * file;
+	int start;
+	int end;
+	int in_comment;
+	int out0;
+	int out1;
+	int converged;
+	int fixup;
+} hlChunk;
+
+struct editorHistogram {
+	unsigned long count;
+	unsigned long max;
+	unsigned long buckets[KILO_HIST_BUCKETS];
+};
+
+struct editorStats {
+	int enabled;
+	int overlay;
+	char * dumpfile;
+	struct editorHistogram hist[STAT_NUM];
+	unsigned long byteswritten;
+	unsigned long rowshighlighted;
+	unsigned long frames;
+	unsigned long keytime;
+};
+
+extern struct editorSyntax HLDB[];
+extern erow editorEmptyRow;
+extern unsigned int HLDB_ENTRIES;
+extern struct editorStats ST;
+extern char * statNames[STAT_NUM];
+
+/*** stats.c ***/
+
+unsigned long editorNanos();
+unsigned long editorHistValue(int bucket);
+unsigned long editorHistPercentile(struct editorHistogram * h, double p);
+void editorStatRecord(int stat, unsigned long ns);
+unsigned long editorStatStart();
+void editorStatEnd(int stat, unsigned long start);
+int editorFormatNanos(char * buf, int size, unsigned long ns);
+int editorStatLine(char * buf, int size, int stat);
+void editorStatInit();
+
+/*** pool.c ***/
+
+void editorPoolInit(int numthreads);
+void editorPoolFree();
+int editorPoolSize();
+void editorPoolRun(void (* job)(void *, int), void * arg, int numjobs);
+
+/*** loop.c ***/
+
+int editorLoopInit(void (* wake)(void *, int), void * arg);
+void editorLoopWatch(int fd, void (* cb)(void *, int), void * arg);
+void editorLoopSignal(int sig, void (* cb)(void *, int), void * arg);
+void editorLoopTimer(long ms, void (* cb)(void *, int), void * arg);
+void editorLoopWake();
+int editorLoopRun(long timeout);
+
+/*** syntax.c ***/
+
+int is_separator(int c);
+int editorHighlightRow(struct editorSyntax * syntax, erow * row, unsigned char * hl, int in_comment);
+void editorUpdateSyntax(efile * F, erow * row);
+void editorHighlightRows(efile * F, int start, int end);
+void editorSelectSyntaxHighlight(efile * F);
+int editorFoldRange(efile * F, int at, int * start, int * end);
+
+/*** buffer.c ***/
+
+efile * editorCreateFile();
+void editorDestroyFile(efile * F);
+void removeHighlight(efile * F);
+void editorRenderRow(erow * row);
+void editorUpdateRow(efile * F, erow * row);
+void editorInsertRow(efile * F, int at, char * s, size_t len);
+void editorFreeRow(erow * row);
+void editorDelRow(efile * F, int at);
+void editorRowInsertChar(efile * F, erow * row, int at, int c);
+void editorRowAppendString(efile * F, erow * row, char * s, size_t len);
+void editorRowDelChar(efile * F, erow * row, int at);
+void editorInsertChar(efile * F, int c);
+void editorInsertNewline(efile * F);
+char ** editorCopyRows(efile * F, int * numrows);
+void editorPasteRows(efile * F, char ** rows, int numrows);
+void editorDuplicateRow(efile * F);
+void editorDeleteRow(efile * F);
+void editorDelChar(efile * F);
+void editorMoveCursor(efile * F, int key);
+void editorSetCursor(efile * F, int cy, int cx);
+void editorSetMark(efile * F, char * name, int line);
+int editorGetMark(efile * F, char * name);
+void editorRestoreRows(efile * F);
+void editorEvictRows(efile * F);
+
+void editorLoadRow(erow * row, char * s, size_t len);
+void editorAppendRows(efile * F, erow * rows, int numrows);
+int editorLoadStart(efile * F, int fd, int batch);
+void editorLoadCancel(efile * F);
+int editorLoadDrain(efile * F, long budget);
+void editorLoadWait(efile * F);
+int editorLoadProgress(efile * F);
+long editorMonotonicMs();
+
+int editorFollowStart(efile * F, int inotifyfd);
+void editorFollowStop(efile * F);
+int editorFollowRead(efile * F, long budget);
+
+erow * editorFileRow(efile * F, int at);
+
+/*** save.c ***/
+
+void editorRowOwn(efile * F, erow * row);
+void editorRowRelease(efile * F, erow * row);
+int editorSaveStart(efile * F);
+int editorSavePoll(efile * F);
+int editorSaveFinish(efile * F, off_t * written);
+
+/*** utf8.c ***/
+
+int editorCharWidth(int cp);
+int editorUtf8Decode(const char * s, int len, int * cp);
+int editorScanChars(const char * s, int len, int * tabs);
+void editorRowColumns(erow * row, int utf8);
+int editorRowClusterEnd(erow * row, int ro);
+int editorRowCxToRender(erow * row, int cx);
+int editorRowRenderToCx(erow * row, int ro);
+int editorRowRenderToRx(erow * row, int ro);
+int editorRowRxToRender(erow * row, int rx);
+int editorRowCxToRx(erow * row, int cx);
+int editorRowRxToCx(erow * row, int rx);
+int editorRowNextCx(erow * row, int cx);
+int editorRowPrevCx(erow * row, int cx);
+int editorRowClusterCx(erow * row, int cx);
+
+/*** fold.c ***/
+
+int editorFoldVisible(efile * F, int row);
+int editorFoldRow(efile * F, int visible);
+int editorFoldRows(efile * F);
+int editorFoldAt(efile * F, int row);
+void editorFold(efile * F, int start, int end);
+int editorUnfold(efile * F, int row);
+void editorUnfoldAll(efile * F);
+void editorShiftFolds(efile * F, int at, int delta);
+
+/*** bracket.c ***/
+
+int editorIsBracket(erow * row, int j);
+void editorRowBrackets(erow * row);
+void editorBracketInsert(efile * F, int at);
+void editorBracketDelete(efile * F, int at);
+void editorBracketTouch(efile * F, int at);
+void editorBracketRange(efile * F, int start, int end);
+void editorBracketFree(efile * F);
+int editorMatchBracket(efile * F, int cy, int rx, int * my, int * mrx);
+int editorEnclosingBracket(efile * F, int cy, int rx, int * oy, int * orx);
+
+/*** words.c ***/
+
+int editorIsWordChar(int c);
+void editorWordsText(char * s, int len, int delta);
+void editorWordsInsert(efile * F, int at);
+void editorWordsDelete(efile * F, erow * row);
+void editorWordsLeave(efile * F, erow * row);
+void editorWordsEnter(efile * F, erow * row);
+int editorWordsScan(efile * F, long budget);
+void editorWordsForget(efile * F);
+int editorWordsComplete(char * prefix, int len, char ** out, int max);
+int editorWordsCount();
+
+/*** pager.c ***/
+
+void editorMapGuard(char * map, off_t size);
+void editorMapUnguard(char * map);
+off_t editorMapValid(int fd, off_t size);
+int editorIndexPath(char * buf, int size, struct stat * st);
+
+int editorPagerOpen(efile * F, int fd);
+int editorPagerPoll(efile * F);
+int editorPagerProgress(efile * F);
+erow * editorPagerRow(efile * F, int at);
+void editorPagerDrop(efile * F);
+void editorPagerClose(efile * F);
+int editorPagerSearch(efile * F, char * query, int from, int direction, int * rx);
+
+/*** csv.c ***/
+
+int editorFieldSeparator(struct editorSyntax * syntax);
+void editorFieldBegin(struct editorField * f);
+int editorNextField(erow * row, int sep, struct editorField * f);
+int * editorRowFields(erow * row, int sep);
+void editorColumnsStart(efile * F);
+void editorColumnsStop(efile * F);
+void editorColumnsSample(efile * F, int from);
+int editorColumnStart(efile * F, int i, int prevend);
+int editorColumnsRx(efile * F, erow * row, int ro);
+int editorColumnsField(efile * F, erow * row, int ro);
+
+/*** hex.c ***/
+
+int editorIsBinary(int fd);
+int editorHexOpen(efile * F, int fd);
+void editorHexClose(efile * F);
+unsigned char * editorHexRow(efile * F, int at, int * len);
+int editorHexRowSize(efile * F, int at);
+void editorHexCheck(efile * F);
+off_t editorHexOffset(efile * F);
+void editorHexSetCursor(efile * F, int cy, int cx);
+void editorHexMoveCursor(efile * F, int key);
+int editorHexPattern(char * query, char * out);
+off_t editorHexSearch(efile * F, char * pat, int len, off_t from, int direction);
+
+/*** codec.c ***/
+
+int editorCodecDetect(int fd);
+int editorCodecFromName(char * filename);
+int editorCodecAvailable(int type);
+char * editorCodecName(int type);
+struct editorCodec * editorCodecOpen(int type, int fd);
+void editorCodecClose(struct editorCodec * C);
+off_t editorCodecConsumed(struct editorCodec * C);
+ssize_t editorCodecRead(struct editorCodec * C, char * buf, size_t len);
+struct editorCompressor * editorCompressOpen(int type, int fd);
+void editorCompressClose(struct editorCompressor * K);
+int editorCompressWrite(struct editorCompressor * K, char * buf, size_t len);
+off_t editorCompressFinish(struct editorCompressor * K);
+
+/*** search.c ***/
+
+int editorFindRow(efile * F, char * query, int from, int direction, int * rx);
+int editorFindChars(efile * F, char * query, int * cy, int * cx);
+void editorReplaceMatch(efile * F, erow * row, int cx, char * query, char * with);
+long editorReplaceAll(efile * F, char * query, char * with, int cy, int cx);
+int editorGrep(efile * V, efile * src, char * pattern);
 
 #endif
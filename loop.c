@@ -0,0 +1,334 @@
+#include "kilo.h"
+
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*** data ***/
+
+enum editorOpType {
+	OP_WATCH = 1
+};
+
+/* timeouts carry their generation in user_data with the low bit set, which
+ * no editorOp pointer has */
+#define URING_TIMEOUT(gen) (((uint64_t) (gen) << 1) | 1)
+
+typedef struct editorOp {
+	int type;
+	int fd;
+	void (* cb)(void *, int);
+	void * arg;
+} editorOp;
+
+struct editorTimer {
+	long deadline;
+	void (* cb)(void *, int);
+	void * arg;
+};
+
+struct editorLoop {
+	int backend;
+	int wake;
+	int sigpipe[2];
+	void (* wakecb)(void *, int);
+	void * wakearg;
+	void (* sigcb[NSIG])(void *, int);
+	void * sigarg[NSIG];
+	editorOp watch[KILO_LOOP_WATCHES];
+	int numwatches;
+	struct editorTimer * timers;
+	int numtimers;
+	int timercap;
+
+	/* io_uring backend */
+	int ring;
+	unsigned * sqhead, * sqtail, * sqmask, * sqarray;
+	unsigned * cqhead, * cqtail, * cqmask;
+	unsigned sqentries;
+	struct io_uring_sqe * sqes;
+	struct io_uring_cqe * cqes;
+	int tosubmit;
+	long timeout;
+	unsigned long timeoutgen;
+	struct __kernel_timespec ts;
+};
+
+struct editorLoop R = { .wake = -1, .ring = -1 };
+
+/*** timers ***/
+
+long editorLoopNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void editorLoopTimer(long ms, void (* cb)(void *, int), void * arg) {
+	if (R.numtimers == R.timercap) {
+		R.timercap = R.timercap ? R.timercap * 2 : 8;
+		R.timers = realloc(R.timers, sizeof(struct editorTimer) * R.timercap);
+	}
+	struct editorTimer * t = &R.timers[R.numtimers++];
+	t->deadline = editorLoopNow() + ms;
+	t->cb = cb;
+	t->arg = arg;
+}
+
+long editorLoopNextTimer() {
+	long next = -1;
+	for (int i = 0; i < R.numtimers; i++) {
+		if (next == -1 || R.timers[i].deadline < next) next = R.timers[i].deadline;
+	}
+	return next;
+}
+
+int editorLoopFireTimers() {
+	long now = editorLoopNow();
+	int fired = 0;
+	for (int i = 0; i < R.numtimers; i++) {
+		if (R.timers[i].deadline > now) continue;
+		struct editorTimer t = R.timers[i];
+		R.timers[i--] = R.timers[--R.numtimers];
+		t.cb(t.arg, 0);
+		fired++;
+	}
+	return fired;
+}
+
+/*** io_uring backend ***/
+
+int editorUringEnter(int min) {
+	int flags = min ? IORING_ENTER_GETEVENTS : 0;
+	int ret = syscall(__NR_io_uring_enter, R.ring, R.tosubmit, min, flags, NULL, 0);
+	if (ret > 0) R.tosubmit -= ret;
+	return ret;
+}
+
+struct io_uring_sqe * editorUringSqe() {
+	unsigned tail = *R.sqtail;
+	if (tail - __atomic_load_n(R.sqhead, __ATOMIC_ACQUIRE) == R.sqentries) editorUringEnter(0);
+	struct io_uring_sqe * sqe = &R.sqes[tail & *R.sqmask];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+void editorUringCommit() {
+	unsigned tail = *R.sqtail;
+	R.sqarray[tail & *R.sqmask] = tail & *R.sqmask;
+	__atomic_store_n(R.sqtail, tail + 1, __ATOMIC_RELEASE);
+	R.tosubmit++;
+}
+
+void editorUringPoll(editorOp * op) {
+	struct io_uring_sqe * sqe = editorUringSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = op->fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = (uintptr_t) op;
+	editorUringCommit();
+}
+
+/* an earlier deadline replaces the pending timeout rather than piling up
+ * next to it; only the latest generation clears R.timeout */
+void editorUringTimeout(long deadline) {
+	struct io_uring_sqe * sqe;
+	if (R.timeout) {
+		sqe = editorUringSqe();
+		sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = URING_TIMEOUT(R.timeoutgen);
+		sqe->user_data = URING_TIMEOUT(0);
+		editorUringCommit();
+	}
+
+	long ms = deadline - editorLoopNow();
+	if (ms < 0) ms = 0;
+	R.ts.tv_sec = ms / 1000;
+	R.ts.tv_nsec = (ms % 1000) * 1000000;
+	R.timeout = deadline;
+	R.timeoutgen++;
+	sqe = editorUringSqe();
+	sqe->opcode = IORING_OP_TIMEOUT;
+	sqe->fd = -1;
+	sqe->addr = (uintptr_t) &R.ts;
+	sqe->len = 1;
+	sqe->user_data = URING_TIMEOUT(R.timeoutgen);
+	editorUringCommit();
+}
+
+int editorUringInit() {
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	R.ring = syscall(__NR_io_uring_setup, KILO_LOOP_ENTRIES, &p);
+	if (R.ring == -1) return -1;
+
+	size_t sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	size_t cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && cqsize > sqsize) sqsize = cqsize;
+	char * sq = mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, R.ring, IORING_OFF_SQ_RING);
+	char * cq = sq;
+	if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP)) {
+		cq = mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, R.ring, IORING_OFF_CQ_RING);
+	}
+	R.sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, R.ring, IORING_OFF_SQES);
+	if (sq == MAP_FAILED || cq == MAP_FAILED || R.sqes == MAP_FAILED) {
+		close(R.ring);
+		R.ring = -1;
+		return -1;
+	}
+
+	R.sqhead = (unsigned *) (sq + p.sq_off.head);
+	R.sqtail = (unsigned *) (sq + p.sq_off.tail);
+	R.sqmask = (unsigned *) (sq + p.sq_off.ring_mask);
+	R.sqarray = (unsigned *) (sq + p.sq_off.array);
+	R.sqentries = p.sq_entries;
+	R.cqhead = (unsigned *) (cq + p.cq_off.head);
+	R.cqtail = (unsigned *) (cq + p.cq_off.tail);
+	R.cqmask = (unsigned *) (cq + p.cq_off.ring_mask);
+	R.cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+	return 0;
+}
+
+int editorUringDispatch(uint64_t data, int res) {
+	if (data & 1) {
+		if (data == URING_TIMEOUT(R.timeoutgen)) R.timeout = 0;
+		return 0;
+	}
+	editorOp * op = (editorOp *) (uintptr_t) data;
+	if (res == -ECANCELED) return 0;
+	op->cb(op->arg, res);
+	editorUringPoll(op);
+	return 1;
+}
+
+int editorUringWait(long deadline) {
+	int wait = (deadline == -1 || deadline > editorLoopNow());
+	if (wait && deadline != -1 && (R.timeout == 0 || deadline < R.timeout)) editorUringTimeout(deadline);
+	if (editorUringEnter(wait) == -1 && errno != EINTR && errno != EBUSY) return -1;
+
+	int handled = 0;
+	unsigned head = *R.cqhead;
+	while (head != __atomic_load_n(R.cqtail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe * cqe = &R.cqes[head & *R.cqmask];
+		uint64_t data = cqe->user_data;
+		int res = cqe->res;
+		__atomic_store_n(R.cqhead, ++head, __ATOMIC_RELEASE);
+		handled += editorUringDispatch(data, res);
+	}
+	if (R.tosubmit) editorUringEnter(0);
+	return handled;
+}
+
+/*** poll backend ***/
+
+int editorPollWait(long deadline) {
+	struct pollfd pfd[KILO_LOOP_WATCHES];
+	for (int i = 0; i < R.numwatches; i++) {
+		pfd[i].fd = R.watch[i].fd;
+		pfd[i].events = POLLIN;
+		pfd[i].revents = 0;
+	}
+	long timeout = -1;
+	if (deadline != -1) {
+		timeout = deadline - editorLoopNow();
+		if (timeout < 0) timeout = 0;
+	}
+	if (poll(pfd, R.numwatches, timeout) == -1) return (errno == EINTR) ? 0 : -1;
+
+	int handled = 0;
+	for (int i = 0; i < R.numwatches; i++) {
+		if (pfd[i].revents == 0) continue;
+		R.watch[i].cb(R.watch[i].arg, pfd[i].revents);
+		handled++;
+	}
+	return handled;
+}
+
+/*** loop ***/
+
+void editorLoopSignalHandler(int sig) {
+	int saved = errno;
+	char c = sig;
+	if (write(R.sigpipe[1], &c, 1) == -1) {}
+	errno = saved;
+}
+
+void editorLoopSignalReady(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	unsigned char sigs[16];
+	ssize_t n = read(R.sigpipe[0], sigs, sizeof(sigs));
+	for (ssize_t i = 0; i < n; i++) {
+		if (R.sigcb[sigs[i]]) R.sigcb[sigs[i]](R.sigarg[sigs[i]], sigs[i]);
+	}
+}
+
+void editorLoopWakeReady(void * arg, int res) {
+	(void) arg;
+	(void) res;
+	uint64_t count;
+	if (read(R.wake, &count, sizeof(count)) == -1) {}
+	if (R.wakecb) R.wakecb(R.wakearg, 0);
+}
+
+void editorLoopWatch(int fd, void (* cb)(void *, int), void * arg) {
+	if (R.numwatches == KILO_LOOP_WATCHES) return;
+	editorOp * op = &R.watch[R.numwatches++];
+	op->type = OP_WATCH;
+	op->fd = fd;
+	op->cb = cb;
+	op->arg = arg;
+	if (R.backend == LOOP_URING) editorUringPoll(op);
+}
+
+/* signals are turned into bytes on a pipe so their callbacks run on the loop thread */
+void editorLoopSignal(int sig, void (* cb)(void *, int), void * arg) {
+	R.sigcb[sig] = cb;
+	R.sigarg[sig] = arg;
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = editorLoopSignalHandler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(sig, &sa, NULL);
+}
+
+/* safe to call from any thread, runs the wake callback on the loop thread */
+void editorLoopWake() {
+	uint64_t one = 1;
+	if (R.wake != -1 && write(R.wake, &one, sizeof(one)) == -1) {}
+}
+
+/* KILO_LOOP=poll skips io_uring */
+int editorLoopInit(void (* wake)(void *, int), void * arg) {
+	R.wakecb = wake;
+	R.wakearg = arg;
+	R.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (R.wake == -1 || pipe(R.sigpipe) == -1) return -1;
+	fcntl(R.sigpipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(R.sigpipe[1], F_SETFL, O_NONBLOCK);
+
+	char * env = getenv("KILO_LOOP");
+	R.backend = LOOP_POLL;
+	if ((env == NULL || strcmp(env, "poll")) && editorUringInit() == 0) R.backend = LOOP_URING;
+
+	editorLoopWatch(R.wake, editorLoopWakeReady, NULL);
+	editorLoopWatch(R.sigpipe[0], editorLoopSignalReady, NULL);
+	return R.backend;
+}
+
+/* wait for at most timeout ms (-1 blocks) and run the callbacks that are due */
+int editorLoopRun(long timeout) {
+	long deadline = (timeout < 0) ? -1 : editorLoopNow() + timeout;
+	long next = editorLoopNextTimer();
+	if (next != -1 && (deadline == -1 || next < deadline)) deadline = next;
+
+	int handled = 0;
+	if (R.backend == LOOP_URING) handled = editorUringWait(deadline);
+	else if (R.backend == LOOP_POLL) handled = editorPollWait(deadline);
+	if (handled < 0) return -1;
+	return handled + editorLoopFireTimers();
+}
@@ -0,0 +1,507 @@
+#include "kilo.h"
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*** data ***/
+
+typedef struct pagerBlock {
+	int block;
+	int numrows;
+	long bytes;
+	erow * rows;
+	struct pagerBlock * prev;
+	struct pagerBlock * next;
+} pagerBlock;
+
+struct editorPager {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int threaded;
+	int fd;
+	struct stat st;
+	char * map;
+	off_t size;
+	off_t indexed;
+	long numlines;
+	off_t * checkpoints;
+	long numcheckpoints;
+	long checkpointcap;
+	int done;
+	int reported;
+	int cancel;
+	long pagesize;
+	pagerBlock * head;
+	pagerBlock * tail;
+	long bytes;
+};
+
+struct editorIndexHeader {
+	char magic[8];
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+	long stride;
+	long numlines;
+	long numcheckpoints;
+};
+
+/* a mapping watched for faults */
+struct editorMapping {
+	char * map;
+	off_t size;
+};
+
+struct editorMapping editorMappings[KILO_MAP_GUARDS];
+long editorMapPagesize;
+
+/*** mappings ***/
+
+/* a file truncated under its mapping raises SIGBUS on the pages past its
+ * new end; those are answered with a page of zeros, so a read that races
+ * a truncation finds nothing there instead of killing the editor. Faults
+ * anywhere else still do */
+void editorMapFault(int sig, siginfo_t * info, void * context) {
+	(void) context;
+	char * addr = info->si_addr;
+	for (int i = 0; i < KILO_MAP_GUARDS; i++) {
+		char * map = editorMappings[i].map;
+		if (map == NULL || addr < map || addr >= map + editorMappings[i].size) continue;
+		char * page = (char *) ((uintptr_t) addr & ~(editorMapPagesize - 1));
+		if (mmap(page, editorMapPagesize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != MAP_FAILED) return;
+	}
+	signal(sig, SIG_DFL);
+}
+
+void editorMapGuard(char * map, off_t size) {
+	if (editorMapPagesize == 0) {
+		editorMapPagesize = sysconf(_SC_PAGESIZE);
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = editorMapFault;
+		sa.sa_flags = SA_SIGINFO;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGBUS, &sa, NULL);
+	}
+	for (int i = 0; i < KILO_MAP_GUARDS; i++) {
+		if (editorMappings[i].map != NULL) continue;
+		editorMappings[i].size = size;
+		editorMappings[i].map = map;
+		return;
+	}
+}
+
+void editorMapUnguard(char * map) {
+	for (int i = 0; i < KILO_MAP_GUARDS; i++) {
+		if (editorMappings[i].map == map) editorMappings[i].map = NULL;
+	}
+}
+
+/* bytes of a mapping of size still backed by fd, which is less once the
+ * file has been truncated */
+off_t editorMapValid(int fd, off_t size) {
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size < size) return st.st_size;
+	return size;
+}
+
+/*** index cache ***/
+
+/* sidecar index for a file, named by device and inode under the cache
+ * directory; -1 when caching is off or there is nowhere to put it */
+int editorIndexPath(char * buf, int size, struct stat * st) {
+	char * env = getenv("KILO_INDEX_CACHE");
+	if (env && !strcmp(env, "off")) return -1;
+
+	char dir[4096];
+	char * xdg = getenv("XDG_CACHE_HOME");
+	char * home = getenv("HOME");
+	if (xdg && *xdg) snprintf(dir, sizeof(dir), "%s", xdg);
+	else if (home && *home) snprintf(dir, sizeof(dir), "%s/.cache", home);
+	else return -1;
+	mkdir(dir, 0700);
+	int len = strlen(dir);
+	snprintf(dir + len, sizeof(dir) - len, "/kilo");
+	if (mkdir(dir, 0700) == -1 && errno != EEXIST) return -1;
+
+	if (snprintf(buf, size, "%s/%lx-%lx.idx", dir, (unsigned long) st->st_dev, (unsigned long) st->st_ino) >= size) return -1;
+	return 0;
+}
+
+/* adopt a cached index if it was written for this very version of the file */
+int editorIndexLoad(struct editorPager * P) {
+	char path[4096];
+	if (editorIndexPath(path, sizeof(path), &P->st) == -1) return -1;
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) return -1;
+
+	struct editorIndexHeader h;
+	int ok = read(fd, &h, sizeof(h)) == sizeof(h) && !memcmp(h.magic, "KILOIDX1", 8) &&
+		h.dev == P->st.st_dev && h.ino == P->st.st_ino && h.size == P->st.st_size &&
+		h.mtime.tv_sec == P->st.st_mtim.tv_sec && h.mtime.tv_nsec == P->st.st_mtim.tv_nsec &&
+		h.stride == KILO_PAGER_STRIDE && h.numcheckpoints > 0 && h.numlines >= 0;
+	if (ok) {
+		size_t len = sizeof(off_t) * h.numcheckpoints;
+		off_t * checkpoints = malloc(len);
+		ok = read(fd, checkpoints, len) == (ssize_t) len && checkpoints[0] == 0 &&
+			checkpoints[h.numcheckpoints - 1] <= P->size;
+		if (ok) {
+			free(P->checkpoints);
+			P->checkpoints = checkpoints;
+			P->numcheckpoints = P->checkpointcap = h.numcheckpoints;
+			P->numlines = h.numlines;
+			P->indexed = P->size;
+			P->done = 1;
+		} else {
+			free(checkpoints);
+		}
+	}
+	close(fd);
+	return ok ? 0 : -1;
+}
+
+/* written next to a temporary name and renamed so readers never see half of it */
+void editorIndexSave(struct editorPager * P) {
+	struct stat st;
+	if (fstat(P->fd, &st) == -1 || st.st_size != P->st.st_size ||
+		st.st_mtim.tv_sec != P->st.st_mtim.tv_sec || st.st_mtim.tv_nsec != P->st.st_mtim.tv_nsec) return;
+	char path[4096], tmp[4160];
+	if (editorIndexPath(path, sizeof(path), &P->st) == -1) return;
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+
+	struct editorIndexHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "KILOIDX1", 8);
+	h.dev = P->st.st_dev;
+	h.ino = P->st.st_ino;
+	h.size = P->st.st_size;
+	h.mtime = P->st.st_mtim;
+	h.stride = KILO_PAGER_STRIDE;
+	h.numlines = P->numlines;
+	h.numcheckpoints = P->numcheckpoints;
+
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1) return;
+	size_t len = sizeof(off_t) * P->numcheckpoints;
+	int ok = write(fd, &h, sizeof(h)) == sizeof(h) && write(fd, P->checkpoints, len) == (ssize_t) len;
+	close(fd);
+	if (!ok || rename(tmp, path) == -1) unlink(tmp);
+}
+
+/*** index ***/
+
+/* drop mapped pages from our resident set once their bytes have been copied;
+ * faults map whole aligned windows around the faulting page, so the release
+ * reaches that far past both ends and the neighbours simply fault back in */
+void editorPagerRelease(struct editorPager * P, off_t start, off_t end) {
+	start = (start > KILO_PAGER_AROUND) ? (start - KILO_PAGER_AROUND) & ~(P->pagesize - 1) : 0;
+	end += KILO_PAGER_AROUND;
+	if (end > P->size) end = P->size;
+	end = (end + P->pagesize - 1) & ~(P->pagesize - 1);
+	if (end > start) madvise(P->map + start, end - start, MADV_DONTNEED);
+}
+
+void * editorPagerThread(void * arg) {
+	struct editorPager * P = arg;
+	off_t off = 0;
+	long lines = 0;
+
+	/* a file truncated while it is indexed ends where it now does */
+	off_t size;
+	while (off < (size = editorMapValid(P->fd, P->size))) {
+		off_t chunk = size - off;
+		if (chunk > KILO_PAGER_SCAN) chunk = KILO_PAGER_SCAN;
+		char * p = P->map + off;
+		char * end = p + chunk;
+		pthread_mutex_lock(&P->lock);
+		while ((p = memchr(p, '\n', end - p)) != NULL) {
+			p++;
+			if (++lines % KILO_PAGER_STRIDE) continue;
+			if (P->numcheckpoints == P->checkpointcap) {
+				P->checkpointcap *= 2;
+				P->checkpoints = realloc(P->checkpoints, sizeof(off_t) * P->checkpointcap);
+			}
+			P->checkpoints[P->numcheckpoints++] = p - P->map;
+		}
+		off += chunk;
+		P->indexed = off;
+		P->numlines = lines;
+		int cancel = P->cancel;
+		pthread_mutex_unlock(&P->lock);
+
+		editorPagerRelease(P, off - chunk, off);
+		editorLoopWake();
+		if (cancel) return NULL;
+	}
+
+	pthread_mutex_lock(&P->lock);
+	if (off > 0 && P->map[off - 1] != '\n') lines++;
+	P->numlines = lines;
+	P->done = 1;
+	pthread_mutex_unlock(&P->lock);
+	editorLoopWake();
+
+	/* the thread owns the checkpoints until done, nothing appends after it */
+	editorIndexSave(P);
+	return NULL;
+}
+
+/* map fd read-only and start indexing it in the background, unless an
+ * index cached by an earlier open still matches the file */
+int editorPagerOpen(efile * F, int fd) {
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0) return -1;
+	char * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) return -1;
+
+	struct editorPager * P = malloc(sizeof(struct editorPager));
+	P->fd = fd;
+	P->st = st;
+	P->map = map;
+	P->size = st.st_size;
+	P->indexed = 0;
+	P->numlines = 0;
+	P->checkpointcap = 1024;
+	P->checkpoints = malloc(sizeof(off_t) * P->checkpointcap);
+	P->checkpoints[0] = 0;
+	P->numcheckpoints = 1;
+	P->done = 0;
+	P->reported = 0;
+	P->cancel = 0;
+	P->pagesize = sysconf(_SC_PAGESIZE);
+	P->head = P->tail = NULL;
+	P->bytes = 0;
+	pthread_mutex_init(&P->lock, NULL);
+	editorMapGuard(map, st.st_size);
+	P->threaded = (editorIndexLoad(P) == -1);
+	if (P->threaded) madvise(map, st.st_size, MADV_SEQUENTIAL);
+	if (P->threaded && pthread_create(&P->thread, NULL, editorPagerThread, P) != 0) {
+		editorMapUnguard(map);
+		pthread_mutex_destroy(&P->lock);
+		free(P->checkpoints);
+		free(P);
+		munmap(map, st.st_size);
+		return -1;
+	}
+	F->pager = P;
+	F->size = st.st_size;
+	/* no thread will wake the loop for a cached index, its lines are all in */
+	if (!P->threaded) editorPagerPoll(F);
+	return 0;
+}
+
+/* pick up lines indexed since the last call, returns 1 if anything changed;
+ * rows are counted in an int, so a file with more lines than
+ * KILO_PAGER_MAXROWS shows only that many */
+int editorPagerPoll(efile * F) {
+	struct editorPager * P = F->pager;
+	pthread_mutex_lock(&P->lock);
+	long numlines = P->numlines;
+	int done = P->done;
+	pthread_mutex_unlock(&P->lock);
+	int numrows = (numlines > KILO_PAGER_MAXROWS) ? KILO_PAGER_MAXROWS : numlines;
+	if (numrows == F->numrows && done == P->reported) return 0;
+	F->numrows = numrows;
+	P->reported = done;
+	return 1;
+}
+
+int editorPagerProgress(efile * F) {
+	struct editorPager * P = F->pager;
+	pthread_mutex_lock(&P->lock);
+	int percent = P->done ? 100 : (int) (P->indexed * 100 / P->size);
+	pthread_mutex_unlock(&P->lock);
+	return percent;
+}
+
+/*** blocks ***/
+
+void editorPagerUnlink(struct editorPager * P, pagerBlock * B) {
+	if (B->prev) B->prev->next = B->next;
+	else P->head = B->next;
+	if (B->next) B->next->prev = B->prev;
+	else P->tail = B->prev;
+}
+
+void editorPagerPush(struct editorPager * P, pagerBlock * B) {
+	B->prev = NULL;
+	B->next = P->head;
+	if (P->head) P->head->prev = B;
+	else P->tail = B;
+	P->head = B;
+}
+
+void editorPagerFreeBlock(struct editorPager * P, pagerBlock * B) {
+	editorPagerUnlink(P, B);
+	for (int i = 0; i < B->numrows; i++) editorFreeRow(&B->rows[i]);
+	free(B->rows);
+	P->bytes -= B->bytes;
+	free(B);
+}
+
+pagerBlock * editorPagerBlock(struct editorPager * P, int block) {
+	for (pagerBlock * B = P->head; B; B = B->next) {
+		if (B->block == block) return B;
+	}
+	return NULL;
+}
+
+/* byte range of a block, end is the next checkpoint or what has been
+ * indexed, and never past the end of a file truncated since */
+void editorPagerRange(struct editorPager * P, int block, off_t * start, off_t * end) {
+	pthread_mutex_lock(&P->lock);
+	*start = P->checkpoints[block];
+	*end = (block + 1 < P->numcheckpoints) ? P->checkpoints[block + 1] : (P->done ? P->size : P->indexed);
+	pthread_mutex_unlock(&P->lock);
+	off_t valid = editorMapValid(P->fd, *end);
+	if (*end > valid) *end = valid;
+	if (*start > *end) *start = *end;
+}
+
+pagerBlock * editorPagerLoad(efile * F, int block) {
+	struct editorPager * P = F->pager;
+	off_t start, end;
+	editorPagerRange(P, block, &start, &end);
+
+	pagerBlock * B = malloc(sizeof(pagerBlock));
+	B->block = block;
+	B->rows = malloc(sizeof(erow) * KILO_PAGER_STRIDE);
+	B->numrows = 0;
+	B->bytes = sizeof(erow) * KILO_PAGER_STRIDE;
+
+	/* the comment state carries over only from a neighbour that is still cached */
+	pagerBlock * prev = (block > 0) ? editorPagerBlock(P, block - 1) : NULL;
+	int in_comment = (prev && prev->numrows) ? prev->rows[prev->numrows - 1].hl_open_comment : 0;
+	int first = block * KILO_PAGER_STRIDE;
+
+	char * p = P->map + start;
+	char * stop = P->map + end;
+	while (B->numrows < KILO_PAGER_STRIDE && first + B->numrows < F->numrows && p < stop) {
+		char * nl = memchr(p, '\n', stop - p);
+		size_t len = (nl ? nl : stop) - p;
+		erow * row = &B->rows[B->numrows];
+		editorLoadRow(row, p, len);
+		row->idx = first + B->numrows;
+		row->hl = malloc(row->rsize ? row->rsize : 1);
+		in_comment = editorHighlightRow(F->syntax, row, row->hl, in_comment);
+		row->hl_open_comment = in_comment;
+		B->bytes += row->size + 2 * row->rsize + 2;
+		B->numrows++;
+		p += len + (nl ? 1 : 0);
+	}
+	editorPagerRelease(P, start, end);
+
+	editorPagerPush(P, B);
+	P->bytes += B->bytes;
+	while (P->bytes > KILO_PAGER_BUDGET && P->tail != B) editorPagerFreeBlock(P, P->tail);
+	return B;
+}
+
+/* materialize row at, only blocks near recent accesses stay resident */
+erow * editorPagerRow(efile * F, int at) {
+	struct editorPager * P = F->pager;
+	int block = at / KILO_PAGER_STRIDE;
+	pagerBlock * B = editorPagerBlock(P, block);
+	if (B && at - block * KILO_PAGER_STRIDE >= B->numrows) {
+		/* built while indexing had not reached this far yet */
+		editorPagerFreeBlock(P, B);
+		B = NULL;
+	}
+	if (B == NULL) {
+		B = editorPagerLoad(F, block);
+	} else if (B != P->head) {
+		editorPagerUnlink(P, B);
+		editorPagerPush(P, B);
+	}
+	/* lines cut off by a truncation are shown empty */
+	if (at - block * KILO_PAGER_STRIDE >= B->numrows) return &editorEmptyRow;
+	return &B->rows[at - block * KILO_PAGER_STRIDE];
+}
+
+void editorPagerDrop(efile * F) {
+	struct editorPager * P = F->pager;
+	while (P->head) editorPagerFreeBlock(P, P->head);
+}
+
+void editorPagerClose(efile * F) {
+	struct editorPager * P = F->pager;
+	pthread_mutex_lock(&P->lock);
+	P->cancel = 1;
+	pthread_mutex_unlock(&P->lock);
+	if (P->threaded) pthread_join(P->thread, NULL);
+	editorPagerDrop(F);
+	editorMapUnguard(P->map);
+	munmap(P->map, P->size);
+	close(P->fd);
+	pthread_mutex_destroy(&P->lock);
+	free(P->checkpoints);
+	free(P);
+	F->pager = NULL;
+	F->numrows = 0;
+}
+
+/*** search ***/
+
+/* case-insensitive scan of the mapped bytes, one block at a time, so search
+ * never materializes rows it does not match */
+int editorPagerSearch(efile * F, char * query, int from, int direction, int * rx) {
+	struct editorPager * P = F->pager;
+	int qlen = strlen(query);
+	if (qlen == 0 || F->numrows == 0) return -1;
+	char * q = malloc(qlen);
+	for (int i = 0; i < qlen; i++) q[i] = tolower((unsigned char) query[i]);
+	char * buf = NULL;
+	long bufsize = 0;
+	int match = -1;
+
+	int numblocks = (F->numrows + KILO_PAGER_STRIDE - 1) / KILO_PAGER_STRIDE;
+	int line = from + direction;
+	if (line < 0) line = F->numrows - 1;
+	else if (line >= F->numrows) line = 0;
+	int block = line / KILO_PAGER_STRIDE;
+
+	for (int n = 0; n <= numblocks && match == -1; n++) {
+		off_t start, end;
+		editorPagerRange(P, block, &start, &end);
+		if (end - start > bufsize) {
+			bufsize = end - start;
+			buf = realloc(buf, bufsize);
+		}
+		for (off_t i = start; i < end; i++) buf[i - start] = tolower((unsigned char) P->map[i]);
+		editorPagerRelease(P, start, end);
+
+		/* lines of this block that are still to be searched on this pass */
+		int first = block * KILO_PAGER_STRIDE;
+		int lo = (n == 0 && direction == 1) ? line : first;
+		int hi = (n == 0 && direction == -1) ? line : first + KILO_PAGER_STRIDE - 1;
+		if (n == numblocks) {
+			if (direction == 1) hi = line - 1;
+			else lo = line + 1;
+		}
+
+		char * p = buf;
+		char * stop = buf + (end - start);
+		for (int l = first; p < stop && l <= hi && l < F->numrows; l++) {
+			char * nl = memchr(p, '\n', stop - p);
+			char * eol = nl ? nl : stop;
+			if (l >= lo && memmem(p, eol - p, q, qlen)) {
+				match = l;
+				if (direction == 1) break;
+			}
+			p = eol + 1;
+		}
+
+		if (direction == 1) block = (block + 1 < numblocks) ? block + 1 : 0;
+		else block = (block > 0) ? block - 1 : numblocks - 1;
+	}
+	free(buf);
+	free(q);
+	if (match == -1) return -1;
+
+	/* the column comes from the render, where tabs have been expanded */
+	erow * row = editorPagerRow(F, match);
+	char * hit = strcasestr(row->render, query);
+	*rx = hit ? hit - row->render : 0;
+	return match;
+}
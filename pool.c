@@ -0,0 +1,111 @@
+#include "kilo.h"
+
+/*** data ***/
+
+struct editorPool {
+	pthread_t * threads;
+	int numthreads;
+	pthread_mutex_t lock;
+	pthread_mutex_t run;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	void (* job)(void *, int);
+	void * arg;
+	int numjobs;
+	int nextjob;
+	int pending;
+	int quit;
+};
+
+struct editorPool P;
+
+pthread_mutex_t poolinit = PTHREAD_MUTEX_INITIALIZER;
+
+/*** workers ***/
+
+void * editorPoolThread(void * arg) {
+	(void) arg;
+	pthread_mutex_lock(&P.lock);
+	while (1) {
+		while (P.nextjob >= P.numjobs && !P.quit) pthread_cond_wait(&P.work, &P.lock);
+		if (P.quit) break;
+		int j = P.nextjob++;
+		pthread_mutex_unlock(&P.lock);
+		P.job(P.arg, j);
+		pthread_mutex_lock(&P.lock);
+		if (--P.pending == 0) pthread_cond_signal(&P.idle);
+	}
+	pthread_mutex_unlock(&P.lock);
+	return NULL;
+}
+
+void editorPoolInit(int numthreads) {
+	if (numthreads < 1) numthreads = 1;
+	if (numthreads > KILO_MAX_THREADS) numthreads = KILO_MAX_THREADS;
+	P.numthreads = numthreads;
+	P.numjobs = 0;
+	P.nextjob = 0;
+	P.pending = 0;
+	P.quit = 0;
+	pthread_mutex_init(&P.lock, NULL);
+	pthread_mutex_init(&P.run, NULL);
+	pthread_cond_init(&P.work, NULL);
+	pthread_cond_init(&P.idle, NULL);
+
+	/* the calling thread takes jobs too, so spawn one less */
+	P.threads = malloc(sizeof(pthread_t) * numthreads);
+	for (int i = 1; i < numthreads; i++) {
+		if (pthread_create(&P.threads[i], NULL, editorPoolThread, NULL) != 0) {
+			P.numthreads = i;
+			break;
+		}
+	}
+}
+
+void editorPoolFree() {
+	if (P.threads == NULL) return;
+	pthread_mutex_lock(&P.lock);
+	P.quit = 1;
+	pthread_cond_broadcast(&P.work);
+	pthread_mutex_unlock(&P.lock);
+	for (int i = 1; i < P.numthreads; i++) pthread_join(P.threads[i], NULL);
+	pthread_mutex_destroy(&P.lock);
+	pthread_mutex_destroy(&P.run);
+	pthread_cond_destroy(&P.work);
+	pthread_cond_destroy(&P.idle);
+	free(P.threads);
+	P.threads = NULL;
+}
+
+int editorPoolSize() {
+	pthread_mutex_lock(&poolinit);
+	if (P.threads == NULL) {
+		char * env = getenv("KILO_THREADS");
+		editorPoolInit(env ? atoi(env) : (int) sysconf(_SC_NPROCESSORS_ONLN));
+	}
+	pthread_mutex_unlock(&poolinit);
+	return P.numthreads;
+}
+
+/* buffers may be driven from several threads, one batch runs at a time */
+void editorPoolRun(void (* job)(void *, int), void * arg, int numjobs) {
+	editorPoolSize();
+	pthread_mutex_lock(&P.run);
+	pthread_mutex_lock(&P.lock);
+	P.job = job;
+	P.arg = arg;
+	P.pending = numjobs;
+	P.nextjob = 0;
+	P.numjobs = numjobs;
+	pthread_cond_broadcast(&P.work);
+	while (P.nextjob < P.numjobs) {
+		int j = P.nextjob++;
+		pthread_mutex_unlock(&P.lock);
+		job(arg, j);
+		pthread_mutex_lock(&P.lock);
+		P.pending--;
+	}
+	while (P.pending > 0) pthread_cond_wait(&P.idle, &P.lock);
+	pthread_mutex_unlock(&P.lock);
+	pthread_mutex_unlock(&P.run);
+}
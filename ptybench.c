@@ -0,0 +1,306 @@
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/*** data ***/
+
+typedef struct ptyKey {
+	int delay;
+	char seq[16];
+	int len;
+} ptyKey;
+
+typedef struct ptySample {
+	double latency;
+	long bytes;
+	int frames;
+} ptySample;
+
+struct ptyParser {
+	int state;
+	char csi[32];
+	int csilen;
+	long frames;
+	long csis;
+	long text;
+};
+
+enum ptyState {
+	PTY_TEXT = 0,
+	PTY_ESC,
+	PTY_CSI
+};
+
+struct {
+	int fd;
+	pid_t pid;
+	struct ptyParser parser;
+	double lastframe;
+	long bytes;
+	ptyKey * keys;
+	int numkeys;
+	int cap;
+} T;
+
+/*** util ***/
+
+void die(const char * s) {
+	perror(s);
+	if (T.pid > 0) kill(T.pid, SIGKILL);
+	exit(1);
+}
+
+double ptyNow() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int ptyCompare(const void * a, const void * b) {
+	double x = *(const double *) a;
+	double y = *(const double *) b;
+	return (x > y) - (x < y);
+}
+
+/*** traces ***/
+
+void ptyPushKey(int delay, const char * seq, int len) {
+	if (T.numkeys == T.cap) {
+		T.cap = T.cap ? T.cap * 2 : 256;
+		T.keys = realloc(T.keys, sizeof(ptyKey) * T.cap);
+	}
+	ptyKey * k = &T.keys[T.numkeys++];
+	k->delay = delay;
+	memcpy(k->seq, seq, len);
+	k->len = len;
+}
+
+/* same notation as bench.c: literal characters, {NAME} for special keys, {^X} for Ctrl-X */
+void ptyKeys(int delay, const char * s) {
+	struct { char * name; char * seq; } names[] = {
+		{ "UP", "\x1b[A" }, { "DOWN", "\x1b[B" }, { "RIGHT", "\x1b[C" }, { "LEFT", "\x1b[D" },
+		{ "S-UP", "\x1b[1;2A" }, { "S-DOWN", "\x1b[1;2B" }, { "S-RIGHT", "\x1b[1;2C" }, { "S-LEFT", "\x1b[1;2D" },
+		{ "PGUP", "\x1b[5~" }, { "PGDN", "\x1b[6~" }, { "HOME", "\x1b[H" }, { "END", "\x1b[F" },
+		{ "DEL", "\x1b[3~" }, { "BS", "\x7f" }, { "ESC", "\x1b" }, { "ENTER", "\r" }, { "TAB", "\t" }, { "S-TAB", "\x1b[Z" }
+	};
+
+	while (*s && *s != '\n') {
+		if (*s != '{') {
+			ptyPushKey(delay, s++, 1);
+			continue;
+		}
+		const char * end = strchr(s, '}');
+		if (end == NULL) break;
+		int len = end - s - 1;
+		if (s[1] == '^' && len == 2) {
+			char c = s[2] & 0x1f;
+			ptyPushKey(delay, &c, 1);
+		} else {
+			unsigned int i;
+			for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+				if ((int) strlen(names[i].name) == len && !strncmp(&s[1], names[i].name, len)) break;
+			}
+			if (i == sizeof(names) / sizeof(names[0])) {
+				fprintf(stderr, "ptybench: unknown key %.*s\n", len, &s[1]);
+				exit(1);
+			}
+			ptyPushKey(delay, names[i].seq, strlen(names[i].seq));
+		}
+		s = end + 1;
+	}
+}
+
+/* each line is "<delay ms> <keys>", every key on the line is sent delay ms after the previous one */
+void ptyLoadTrace(char * path) {
+	FILE * fp = fopen(path, "r");
+	if (fp == NULL) die(path);
+	char * line = NULL;
+	size_t linecap = 0;
+	while (getline(&line, &linecap, fp) != -1) {
+		if (line[0] == '#' || line[0] == '\n') continue;
+		char * keys;
+		int delay = strtol(line, &keys, 10);
+		if (*keys == ' ') keys++;
+		ptyKeys(delay, keys);
+	}
+	free(line);
+	fclose(fp);
+}
+
+void ptySyntheticTrace(int rate, int numkeys) {
+	const char * script[] = {
+		"the quick brown fox jumps over the lazy dog{ENTER}",
+		"{UP}{UP}{END}{LEFT}{LEFT}{BS}{BS}xy{DOWN}{DOWN}",
+		"{PGDN}{PGDN}{PGUP}{HOME}",
+		"int value = 42; /* comment */{ENTER}"
+	};
+	int delay = 1000 / rate;
+	for (int i = 0; T.numkeys < numkeys; i++) ptyKeys(delay, script[i % 4]);
+	T.numkeys = numkeys;
+}
+
+/*** output parsing ***/
+
+/* kilo hides the cursor while drawing and shows it again as the last sequence of a frame */
+void ptyParse(const char * buf, int len, double now) {
+	struct ptyParser * p = &T.parser;
+	for (int i = 0; i < len; i++) {
+		char c = buf[i];
+		switch (p->state) {
+			case PTY_TEXT:
+				if (c == '\x1b') p->state = PTY_ESC;
+				else p->text++;
+				break;
+			case PTY_ESC:
+				if (c == '[') {
+					p->state = PTY_CSI;
+					p->csilen = 0;
+				} else {
+					p->state = PTY_TEXT;
+				}
+				break;
+			case PTY_CSI:
+				if (p->csilen < (int) sizeof(p->csi) - 1) p->csi[p->csilen++] = c;
+				if (c >= 0x40 && c <= 0x7e) {
+					p->csi[p->csilen] = '\0';
+					p->csis++;
+					if (!strcmp(p->csi, "?25h")) {
+						p->frames++;
+						T.lastframe = now;
+					}
+					p->state = PTY_TEXT;
+				}
+				break;
+		}
+	}
+}
+
+/* read terminal output until the deadline, returns -1 once the child has gone away */
+int ptyPump(double deadline) {
+	char buf[65536];
+	while (1) {
+		double now = ptyNow();
+		if (now >= deadline) return 0;
+		struct pollfd pfd = { T.fd, POLLIN, 0 };
+		int ms = (int) ((deadline - now) * 1000) + 1;
+		if (poll(&pfd, 1, ms) <= 0) continue;
+		ssize_t nread = read(T.fd, buf, sizeof(buf));
+		if (nread <= 0) return -1;
+		T.bytes += nread;
+		ptyParse(buf, nread, ptyNow());
+	}
+}
+
+/*** run ***/
+
+void ptySpawn(char ** argv, int rows, int cols) {
+	struct winsize ws = { rows, cols, 0, 0 };
+	T.pid = forkpty(&T.fd, NULL, NULL, &ws);
+	if (T.pid == -1) die("forkpty");
+	if (T.pid == 0) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+}
+
+void ptyReport(ptySample * samples, int numsamples, double startup) {
+	double * lat = malloc(sizeof(double) * numsamples);
+	long bytes = 0, frames = 0;
+	int n = 0, missed = 0;
+	for (int i = 0; i < numsamples; i++) {
+		bytes += samples[i].bytes;
+		frames += samples[i].frames;
+		if (samples[i].frames) lat[n++] = samples[i].latency;
+		else missed++;
+	}
+	qsort(lat, n, sizeof(double), ptyCompare);
+
+	printf("startup to first frame  %8.2f ms\n", startup * 1e3);
+	printf("keys sent               %8d\n", numsamples);
+	printf("keys without a frame    %8d\n", missed);
+	if (n > 0) {
+		printf("input to final frame    p50 %.2f ms  p99 %.2f ms  max %.2f ms\n", lat[n / 2] * 1e3, lat[(int) (n * 0.99)] * 1e3, lat[n - 1] * 1e3);
+	}
+	printf("bytes per key           %8.0f\n", numsamples ? (double) bytes / numsamples : 0);
+	printf("frames per key          %8.2f\n", numsamples ? (double) frames / numsamples : 0);
+	printf("escape sequences        %8ld\n", T.parser.csis);
+	printf("text bytes              %8ld\n", T.parser.text);
+	free(lat);
+}
+
+int main(int argc, char * argv[]) {
+	int rows = 24, cols = 80, rate = 20, numkeys = 500;
+	char * trace = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:n:t:s:")) != -1) {
+		switch (opt) {
+			case 'r': rate = atoi(optarg); break;
+			case 'n': numkeys = atoi(optarg); break;
+			case 't': trace = optarg; break;
+			case 's': sscanf(optarg, "%dx%d", &rows, &cols); break;
+			default:
+				fprintf(stderr, "usage: %s [-r keys/s] [-n keys] [-t trace] [-s ROWSxCOLS] -- ./kilo [file]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc || rate <= 0) {
+		fprintf(stderr, "usage: %s [-r keys/s] [-n keys] [-t trace] [-s ROWSxCOLS] -- ./kilo [file]\n", argv[0]);
+		return 1;
+	}
+
+	if (trace) ptyLoadTrace(trace);
+	else ptySyntheticTrace(rate, numkeys);
+
+	double start = ptyNow();
+	ptySpawn(&argv[optind], rows, cols);
+	while (T.parser.frames == 0) {
+		if (ptyPump(ptyNow() + 0.01) == -1) die("child exited");
+		if (ptyNow() - start > 10) die("no first frame");
+	}
+	double startup = T.lastframe - start;
+	ptyPump(ptyNow() + 0.2);
+
+	ptySample * samples = malloc(sizeof(ptySample) * (T.numkeys + 1));
+	for (int i = 0; i < T.numkeys; i++) {
+		ptyKey * k = &T.keys[i];
+		long frames = T.parser.frames;
+		T.bytes = 0;
+
+		double sent = ptyNow();
+		if (write(T.fd, k->seq, k->len) != k->len) die("write");
+
+		/* frames that complete before the next key belong to this one, but
+		 * never send the next key before this key has produced a frame */
+		double next = sent + (i + 1 < T.numkeys ? T.keys[i + 1].delay : 200) / 1000.0;
+		if (ptyPump(next) == -1) die("child exited");
+		while (T.parser.frames == frames && ptyNow() - sent < 1.0) {
+			if (ptyPump(ptyNow() + 0.005) == -1) die("child exited");
+		}
+
+		samples[i].frames = T.parser.frames - frames;
+		samples[i].latency = T.lastframe - sent;
+		samples[i].bytes = T.bytes;
+	}
+
+	ptyReport(samples, T.numkeys, startup);
+
+	kill(T.pid, SIGKILL);
+	waitpid(T.pid, NULL, 0);
+	free(samples);
+	free(T.keys);
+	return 0;
+}
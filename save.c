@@ -0,0 +1,228 @@
+#include "kilo.h"
+
+/*** data ***/
+
+struct editorSnapRow {
+	char * chars;
+	int size;
+};
+
+/* a save in flight: the rows as they were when it started, and the chars
+ * arrays edits have replaced since, which the writer may still be reading */
+struct editorSaver {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	char * filename;
+	int codec;
+	struct editorSnapRow * rows;
+	int numrows;
+	int dirty;
+	int done;
+	int error;
+	off_t written;
+	char ** orphans;
+	int numorphans;
+	int orphancap;
+};
+
+/*** snapshots ***/
+
+/* rows whose chars a running save shares; rows made or copied since it
+ * started carry the save's generation */
+int editorRowShared(efile * F, erow * row) {
+	return F->saver && row->snap != F->snapgen;
+}
+
+void editorSaverOrphan(struct editorSaver * S, char * chars) {
+	pthread_mutex_lock(&S->lock);
+	if (S->numorphans == S->orphancap) {
+		S->orphancap = S->orphancap ? S->orphancap * 2 : 64;
+		S->orphans = realloc(S->orphans, sizeof(char *) * S->orphancap);
+	}
+	S->orphans[S->numorphans++] = chars;
+	pthread_mutex_unlock(&S->lock);
+}
+
+/* row->chars is about to change in place, so a save still reading it gets
+ * to keep the old copy */
+void editorRowOwn(efile * F, erow * row) {
+	if (!editorRowShared(F, row)) return;
+	char * chars = malloc(row->size + 1);
+	memcpy(chars, row->chars, row->size + 1);
+	editorSaverOrphan(F->saver, row->chars);
+	row->chars = chars;
+	row->snap = F->snapgen;
+}
+
+/* row->chars is being freed or replaced; safe from pool workers */
+void editorRowRelease(efile * F, erow * row) {
+	if (editorRowShared(F, row)) editorSaverOrphan(F->saver, row->chars);
+	else free(row->chars);
+	row->chars = NULL;
+	row->snap = F->snapgen;
+}
+
+/*** saving ***/
+
+int editorSaveWrite(int fd, char * buf, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, buf, len);
+		if (n == -1 && errno == EINTR) continue;
+		if (n == -1) return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/* a full chunk of the file goes out as it is or through the compressor */
+int editorSaveChunk(struct editorSaver * S, struct editorCompressor * K, int fd, char * buf, size_t len) {
+	if (K) return editorCompressWrite(K, buf, len);
+	if (editorSaveWrite(fd, buf, len) == -1) return -1;
+	S->written += len;
+	return 0;
+}
+
+/* the snapshot is joined into chunks as it is written, compressed files
+ * are compressed a chunk at a time on the way out */
+int editorSaveRows(struct editorSaver * S, int fd) {
+	struct editorCompressor * K = NULL;
+	if (S->codec != CODEC_NONE && (K = editorCompressOpen(S->codec, fd)) == NULL) {
+		errno = EIO;
+		return -1;
+	}
+
+	char * buf = malloc(KILO_LOAD_CHUNK);
+	size_t len = 0;
+	int ret = 0;
+	for (int i = 0; i < S->numrows; i++) {
+		char * chars = S->rows[i].chars;
+		size_t size = S->rows[i].size;
+		/* a chunk is sent once it fills, leaving room for the newline */
+		while (len + size >= KILO_LOAD_CHUNK) {
+			size_t n = KILO_LOAD_CHUNK - len;
+			memcpy(&buf[len], chars, n);
+			chars += n;
+			size -= n;
+			len = 0;
+			if ((ret = editorSaveChunk(S, K, fd, buf, KILO_LOAD_CHUNK)) == -1) break;
+		}
+		if (ret == -1) break;
+		memcpy(&buf[len], chars, size);
+		len += size;
+		buf[len++] = '\n';
+	}
+	if (ret == 0) ret = editorSaveChunk(S, K, fd, buf, len);
+	free(buf);
+	if (K) {
+		off_t written = (ret == 0) ? editorCompressFinish(K) : -1;
+		int error = errno;
+		editorCompressClose(K);
+		if (written == -1) {
+			errno = error;
+			return -1;
+		}
+		S->written = written;
+	}
+	return ret;
+}
+
+/* written next to a temporary name with the file's mode and renamed over
+ * it once synced, so a save that fails or is killed leaves the old file */
+void * editorSaveThread(void * arg) {
+	struct editorSaver * S = arg;
+	/* a symlink is saved through to the file it names */
+	char * path = realpath(S->filename, NULL);
+	if (path == NULL) path = strdup(S->filename);
+	char * tmp = malloc(strlen(path) + 16);
+	sprintf(tmp, "%s.%d", path, (int) getpid());
+
+	int error = 0;
+	struct stat st;
+	int exists = (stat(path, &st) == 0);
+	int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		error = errno;
+	} else {
+		if (exists) {
+			if (fchown(fd, st.st_uid, st.st_gid) == -1) {}
+			if (fchmod(fd, st.st_mode & 07777) == -1) error = errno;
+		}
+		if (error == 0 && (editorSaveRows(S, fd) == -1 || fsync(fd) == -1)) error = errno;
+		if (close(fd) == -1 && error == 0) error = errno;
+		if (error == 0 && rename(tmp, path) == -1) error = errno;
+		if (error) unlink(tmp);
+	}
+	free(tmp);
+	free(path);
+
+	pthread_mutex_lock(&S->lock);
+	S->error = error;
+	S->done = 1;
+	pthread_mutex_unlock(&S->lock);
+	editorLoopWake();
+	return NULL;
+}
+
+/* the rows are captured as pointers, not copied: edits from here on copy a
+ * row before changing it, so typing carries on while the file is written */
+int editorSaveStart(efile * F) {
+	struct editorSaver * S = calloc(1, sizeof(struct editorSaver));
+	pthread_mutex_init(&S->lock, NULL);
+	S->filename = strdup(F->filename);
+	S->codec = F->codec;
+	S->dirty = F->dirty;
+	S->numrows = F->numrows;
+	S->rows = malloc(sizeof(struct editorSnapRow) * (F->numrows ? F->numrows : 1));
+	for (int i = 0; i < F->numrows; i++) {
+		S->rows[i].chars = F->row[i].chars;
+		S->rows[i].size = F->row[i].size;
+	}
+	F->snapgen++;
+	F->saver = S;
+	F->saving = 1;
+	int err = pthread_create(&S->thread, NULL, editorSaveThread, S);
+	if (err != 0) {
+		F->saver = NULL;
+		F->saving = 0;
+		pthread_mutex_destroy(&S->lock);
+		free(S->rows);
+		free(S->filename);
+		free(S);
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+int editorSavePoll(efile * F) {
+	struct editorSaver * S = F->saver;
+	if (S == NULL) return 0;
+	pthread_mutex_lock(&S->lock);
+	int done = S->done;
+	pthread_mutex_unlock(&S->lock);
+	return done;
+}
+
+/* joins a finished save, returning 0 or the errno it failed with; edits
+ * made while it ran leave the file dirty by that many */
+int editorSaveFinish(efile * F, off_t * written) {
+	struct editorSaver * S = F->saver;
+	pthread_join(S->thread, NULL);
+	F->saver = NULL;
+	F->saving = 0;
+	int error = S->error;
+	*written = S->written;
+	if (error == 0) {
+		F->dirty -= S->dirty;
+		F->size = S->written;
+		F->unterminated = 0;
+	}
+	for (int i = 0; i < S->numorphans; i++) free(S->orphans[i]);
+	free(S->orphans);
+	pthread_mutex_destroy(&S->lock);
+	free(S->rows);
+	free(S->filename);
+	free(S);
+	return error;
+}
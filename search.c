@@ -0,0 +1,239 @@
+#include "kilo.h"
+
+/*** search ***/
+
+/* next row after from that contains query, wrapping around; -1 if none */
+int editorFindRow(efile * F, char * query, int from, int direction, int * rx) {
+	if (F->pager) return editorPagerSearch(F, query, from, direction, rx);
+	if (F->hex) return -1;
+	int current = from;
+	for (int i = 0; i < F->numrows; i++) {
+		current += direction;
+		if (current == -1) current = F->numrows - 1;
+		else if (current == F->numrows) current = 0;
+
+		erow * row = editorFileRow(F, current);
+		char * match = strcasestr(row->render, query);
+		if (match) {
+			*rx = match - row->render;
+			return current;
+		}
+	}
+	return -1;
+}
+
+/* first occurrence of query in the raw rows at or after (cy, cx), no wrapping */
+int editorFindChars(efile * F, char * query, int * cy, int * cx) {
+	int from = *cx;
+	for (int i = *cy; i < F->numrows; i++) {
+		erow * row = editorFileRow(F, i);
+		char * match = (from <= row->size) ? strcasestr(&row->chars[from], query) : NULL;
+		if (match) {
+			*cy = i;
+			*cx = match - row->chars;
+			return 1;
+		}
+		from = 0;
+	}
+	return 0;
+}
+
+/*** replace ***/
+
+typedef struct replaceChunk {
+	efile * file;
+	char * query;
+	char * with;
+	int start;
+	int end;
+	int from;
+	long count;
+	int first;
+	int last;
+	erow * stale;
+	int numstale;
+} replaceChunk;
+
+/* every occurrence at or after from rebuilt into a new chars array in one
+ * allocation; the render is left to the caller, and so are the old chars
+ * when keep is set */
+int editorReplaceChars(efile * F, erow * row, int from, char * query, int qlen, char * with, int wlen, int keep) {
+	int count = 0;
+	for (char * p = strcasestr(&row->chars[from], query); p; p = strcasestr(p + qlen, query)) count++;
+	if (count == 0) return 0;
+
+	int size = row->size + count * (wlen - qlen);
+	char * chars = malloc(size + 1);
+	char * src = row->chars;
+	char * dst = chars;
+	memcpy(dst, src, from);
+	src += from;
+	dst += from;
+	for (char * p = strcasestr(src, query); p; p = strcasestr(src, query)) {
+		memcpy(dst, src, p - src);
+		dst += p - src;
+		memcpy(dst, with, wlen);
+		dst += wlen;
+		src = p + qlen;
+	}
+	memcpy(dst, src, &row->chars[row->size] - src);
+	chars[size] = '\0';
+
+	if (keep) row->snap = F->snapgen;
+	else editorRowRelease(F, row);
+	row->chars = chars;
+	row->size = size;
+	return count;
+}
+
+void editorReplaceChunk(void * arg, int j) {
+	replaceChunk * C = &((replaceChunk *) arg)[j];
+	int qlen = strlen(C->query);
+	int wlen = strlen(C->with);
+	C->count = 0;
+	C->first = -1;
+	C->stale = NULL;
+	C->numstale = 0;
+	int cap = 0;
+	for (int i = C->start; i < C->end; i++) {
+		erow * row = &C->file->row[i];
+		erow old = *row;
+		/* the word index is only touched from the caller's thread, so the
+		 * old chars of counted rows are handed back to it */
+		int counted = (i < C->file->wordrows);
+		int n = editorReplaceChars(C->file, row, (i == C->start) ? C->from : 0, C->query, qlen, C->with, wlen, counted);
+		if (n == 0) continue;
+		if (counted) {
+			if (C->numstale == cap) {
+				cap = cap ? cap * 2 : 64;
+				C->stale = realloc(C->stale, sizeof(erow) * cap);
+			}
+			C->stale[C->numstale++] = old;
+		}
+		editorRenderRow(row);
+		C->count += n;
+		if (C->first == -1) C->first = i;
+		C->last = i;
+	}
+}
+
+/* replace one match at cx of row; the caller marks the buffer dirty once
+ * for a run of matches */
+void editorReplaceMatch(efile * F, erow * row, int cx, char * query, char * with) {
+	int qlen = strlen(query);
+	int wlen = strlen(with);
+	int size = row->size - qlen + wlen;
+	editorWordsLeave(F, row);
+	char * chars = malloc(size + 1);
+	memcpy(chars, row->chars, cx);
+	memcpy(&chars[cx], with, wlen);
+	memcpy(&chars[cx + wlen], &row->chars[cx + qlen], row->size - cx - qlen + 1);
+	editorRowRelease(F, row);
+	row->chars = chars;
+	row->size = size;
+	editorUpdateRow(F, row);
+}
+
+/* replace every occurrence from (cy, cx) to the end of the buffer: each row
+ * is rebuilt once, rows are split across the pool and the changed range is
+ * highlighted in one batch, all as a single change */
+long editorReplaceAll(efile * F, char * query, char * with, int cy, int cx) {
+	if (F->pager || F->hex || query[0] == '\0' || cy >= F->numrows) return 0;
+
+	int numrows = F->numrows - cy;
+	int numchunks = numrows / KILO_HL_CHUNK_MIN + 1;
+	if (numchunks > editorPoolSize()) numchunks = editorPoolSize();
+	replaceChunk * chunks = malloc(sizeof(replaceChunk) * numchunks);
+	for (int c = 0; c < numchunks; c++) {
+		chunks[c].file = F;
+		chunks[c].query = query;
+		chunks[c].with = with;
+		chunks[c].start = cy + (long) numrows * c / numchunks;
+		chunks[c].end = cy + (long) numrows * (c + 1) / numchunks;
+		chunks[c].from = (c == 0) ? cx : 0;
+	}
+	editorPoolRun(editorReplaceChunk, chunks, numchunks);
+
+	long count = 0;
+	int first = -1, last = -1;
+	for (int c = 0; c < numchunks; c++) {
+		for (int i = 0; i < chunks[c].numstale; i++) {
+			erow * old = &chunks[c].stale[i];
+			editorWordsText(old->chars, old->size, -1);
+			editorWordsText(F->row[old->idx].chars, F->row[old->idx].size, 1);
+			editorRowRelease(F, old);
+		}
+		free(chunks[c].stale);
+		if (chunks[c].count == 0) continue;
+		count += chunks[c].count;
+		if (first == -1) first = chunks[c].first;
+		last = chunks[c].last;
+	}
+	free(chunks);
+	if (count == 0) return 0;
+
+	editorHighlightRows(F, first, last + 1);
+	F->dirty++;
+	if (F->beginsel[0] != -1) removeHighlight(F);
+	if (F->cy < F->numrows && F->cx > F->row[F->cy].size) F->cx = F->row[F->cy].size;
+	return count;
+}
+
+/*** grep ***/
+
+typedef struct grepChunk {
+	efile * file;
+	char * pattern;
+	int start;
+	int end;
+	int * refs;
+	int numrefs;
+} grepChunk;
+
+void editorGrepChunk(void * arg, int j) {
+	grepChunk * C = &((grepChunk *) arg)[j];
+	int cap = 0;
+	C->refs = NULL;
+	C->numrefs = 0;
+	for (int i = C->start; i < C->end; i++) {
+		if (strcasestr(editorFileRow(C->file, i)->chars, C->pattern) == NULL) continue;
+		if (C->numrefs == cap) {
+			cap = cap ? cap * 2 : 64;
+			C->refs = realloc(C->refs, sizeof(int) * cap);
+		}
+		C->refs[C->numrefs++] = i;
+	}
+}
+
+/* turn the empty buffer V into a read-only view of the rows of src that
+ * contain pattern; the rows stay in src, V only keeps their line numbers */
+int editorGrep(efile * V, efile * src, char * pattern) {
+	if (src->pager || src->hex) return -1;
+
+	int numchunks = src->numrows / KILO_HL_CHUNK_MIN + 1;
+	if (numchunks > editorPoolSize()) numchunks = editorPoolSize();
+	grepChunk * chunks = malloc(sizeof(grepChunk) * numchunks);
+	for (int c = 0; c < numchunks; c++) {
+		chunks[c].file = src;
+		chunks[c].pattern = pattern;
+		chunks[c].start = (long) src->numrows * c / numchunks;
+		chunks[c].end = (long) src->numrows * (c + 1) / numchunks;
+	}
+	editorPoolRun(editorGrepChunk, chunks, numchunks);
+
+	int numrefs = 0;
+	for (int c = 0; c < numchunks; c++) numrefs += chunks[c].numrefs;
+	V->refs = malloc(sizeof(int) * (numrefs ? numrefs : 1));
+	int n = 0;
+	for (int c = 0; c < numchunks; c++) {
+		memcpy(&V->refs[n], chunks[c].refs, sizeof(int) * chunks[c].numrefs);
+		n += chunks[c].numrefs;
+		free(chunks[c].refs);
+	}
+	free(chunks);
+
+	V->source = src;
+	V->numrows = numrefs;
+	V->syntax = src->syntax;
+	return numrefs;
+}
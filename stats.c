@@ -0,0 +1,96 @@
+#include "kilo.h"
+
+/*** data ***/
+
+struct editorStats ST;
+
+char * statNames[STAT_NUM] = { "readkey", "keypress", "highlight", "drawrows", "write", "key-to-frame", "open", "find", "save" };
+
+/*** instrumentation ***/
+
+unsigned long editorNanos() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* log-linear buckets: exact below KILO_HIST_SUB, then KILO_HIST_SUB steps per power of two */
+int editorHistBucket(unsigned long v) {
+	if (v < KILO_HIST_SUB) return v;
+	int msb = 63 - __builtin_clzl(v);
+	return (msb - 2) * KILO_HIST_SUB + ((v >> (msb - 3)) & (KILO_HIST_SUB - 1));
+}
+
+unsigned long editorHistValue(int bucket) {
+	if (bucket < KILO_HIST_SUB) return bucket;
+	int msb = bucket / KILO_HIST_SUB + 2;
+	return (unsigned long) (KILO_HIST_SUB + bucket % KILO_HIST_SUB) << (msb - 3);
+}
+
+unsigned long editorHistPercentile(struct editorHistogram * h, double p) {
+	if (h->count == 0) return 0;
+	unsigned long want = (unsigned long) ceil(h->count * p);
+	unsigned long seen = 0;
+	for (int b = 0; b < KILO_HIST_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= want) return editorHistValue(b);
+	}
+	return h->max;
+}
+
+void editorStatRecord(int stat, unsigned long ns) {
+	struct editorHistogram * h = &ST.hist[stat];
+	h->buckets[editorHistBucket(ns)]++;
+	h->count++;
+	if (ns > h->max) h->max = ns;
+}
+
+unsigned long editorStatStart() {
+	return ST.enabled ? editorNanos() : 0;
+}
+
+void editorStatEnd(int stat, unsigned long start) {
+	if (start) editorStatRecord(stat, editorNanos() - start);
+}
+
+int editorFormatNanos(char * buf, int size, unsigned long ns) {
+	if (ns < 1000) return snprintf(buf, size, "%luns", ns);
+	if (ns < 1000000) return snprintf(buf, size, "%.1fus", ns / 1e3);
+	if (ns < 1000000000) return snprintf(buf, size, "%.2fms", ns / 1e6);
+	return snprintf(buf, size, "%.2fs", ns / 1e9);
+}
+
+int editorStatLine(char * buf, int size, int stat) {
+	struct editorHistogram * h = &ST.hist[stat];
+	char p50[16], p99[16], max[16];
+	editorFormatNanos(p50, sizeof(p50), editorHistPercentile(h, 0.50));
+	editorFormatNanos(p99, sizeof(p99), editorHistPercentile(h, 0.99));
+	editorFormatNanos(max, sizeof(max), h->max);
+	return snprintf(buf, size, "%-12s %9s %9s %9s %8lu", statNames[stat], p50, p99, max, h->count);
+}
+
+void editorStatDump() {
+	FILE * fp = fopen(ST.dumpfile, "w");
+	if (fp == NULL) return;
+	char line[80];
+	fprintf(fp, "%-12s %9s %9s %9s %8s\n", "stat", "p50", "p99", "max", "count");
+	for (int i = 0; i < STAT_NUM; i++) {
+		editorStatLine(line, sizeof(line), i);
+		fprintf(fp, "%s\n", line);
+	}
+	fprintf(fp, "bytes_written %lu\nrows_highlighted %lu\nframes %lu\n", ST.byteswritten, ST.rowshighlighted, ST.frames);
+	for (int i = 0; i < STAT_NUM; i++) {
+		for (int b = 0; b < KILO_HIST_BUCKETS; b++) {
+			if (ST.hist[i].buckets[b]) fprintf(fp, "bucket %s %lu %lu\n", statNames[i], editorHistValue(b), ST.hist[i].buckets[b]);
+		}
+	}
+	fclose(fp);
+}
+
+void editorStatInit() {
+	ST.dumpfile = getenv("KILO_STATS");
+	if (ST.dumpfile && *ST.dumpfile) {
+		ST.enabled = 1;
+		atexit(editorStatDump);
+	}
+}
@@ -0,0 +1,413 @@
+#include "kilo.h"
+
+/*** syntax highlighting ***/
+
+int is_separator(int c) {
+	switch (c) {
+		case '\0': case ',': case '.': case '(': case ')': case '+': case '-': case '/': case '*':
+		case '=': case '~': case '%': case '<': case '>': case '[': case ']': case ';':
+			return 1;
+	}
+	return isspace(c);
+}
+
+/* plain numbers, with a sign, a fraction and an exponent allowed */
+int editorIsNumber(char * s, int len) {
+	int i = 0, digits = 0;
+	if (i < len && (s[i] == '-' || s[i] == '+')) i++;
+	while (i < len && isdigit((unsigned char) s[i])) i++, digits++;
+	if (i < len && s[i] == '.') {
+		i++;
+		while (i < len && isdigit((unsigned char) s[i])) i++, digits++;
+	}
+	if (digits && i < len && (s[i] == 'e' || s[i] == 'E')) {
+		i++;
+		if (i < len && (s[i] == '-' || s[i] == '+')) i++;
+		if (i == len || !isdigit((unsigned char) s[i])) return 0;
+		while (i < len && isdigit((unsigned char) s[i])) i++;
+	}
+	return digits > 0 && i == len;
+}
+
+/* delimited data is highlighted a field at a time: quoted fields as
+ * strings and numeric ones as numbers */
+void editorHighlightFields(erow * row, unsigned char * hl, int sep) {
+	struct editorField f;
+	editorFieldBegin(&f);
+	while (editorNextField(row, sep, &f)) {
+		if (f.ce == f.cs) continue;
+		if (row->chars[f.cs] == '"') memset(&hl[f.rs], HL_STRING, f.re - f.rs);
+		else if (editorIsNumber(&row->chars[f.cs], f.ce - f.cs)) memset(&hl[f.rs], HL_NUMBER, f.re - f.rs);
+	}
+}
+
+int editorHighlightRow(struct editorSyntax * syntax, erow * row, unsigned char * hl, int in_comment) {
+	memset(hl, HL_NORMAL, row->rsize);
+	if (syntax == NULL) return 0;
+	int sep = editorFieldSeparator(syntax);
+	if (sep) {
+		editorHighlightFields(row, hl, sep);
+		return 0;
+	}
+
+	char ** keywords = syntax->keywords;
+	char * scs = syntax->singleline_comment_start;
+	char * mcs = syntax->multiline_comment_start;
+	char * mce = syntax->multiline_comment_end;
+	int scs_len = scs ? strlen(scs) : 0;
+	int mcs_len = mcs ? strlen(mcs) : 0;
+	int mce_len = mce ? strlen(mce) : 0;
+
+	int prev_sep = 1;
+	int in_string = 0;
+
+	int i = 0;
+	while (i < row->rsize) {
+		char c = row->render[i];
+		unsigned char prev_hl = (i > 0) ? hl[i - 1] : HL_NORMAL;
+
+		if (scs_len && !in_string && !in_comment) {
+			if (c == scs[0] && !strncmp(&row->render[i], scs, scs_len)) {
+				memset(&hl[i], HL_COMMENT, row->rsize - i);
+				break;
+			}
+		}
+		
+		if (mcs_len && mce_len && !in_string) {
+			if (in_comment) {
+				hl[i] = HL_MLCOMMENT;
+				if (c == mce[0] && !strncmp(&row->render[i], mce, mce_len)) {
+					memset(&hl[i], HL_MLCOMMENT, mce_len);
+					i += mce_len;
+					in_comment = 0;
+					prev_sep = 1;
+					continue;
+				} else {
+					i++;
+					continue;
+				}
+			} else if (c == mcs[0] && !strncmp(&row->render[i], mcs, mcs_len)) {
+				memset(&hl[i], HL_MLCOMMENT, mcs_len);
+				i += mcs_len;
+				in_comment = 1;
+				continue;
+			}
+		}
+		
+		if (syntax->flags & HL_HIGHLIGHT_STRINGS) {
+			if (in_string) {
+				hl[i] = HL_STRING;
+				if (c == '\\' && i + 1 < row->rsize) {
+					hl[i + 1] = HL_STRING;
+					i += 2;
+					continue;
+				}
+				if (c == in_string) in_string = 0;
+				i++;
+				prev_sep = 1;
+				continue;
+			} else {
+				if (c == '"' || c == '\'') {
+					in_string = c;
+					hl[i] = HL_STRING;
+					i++;
+					continue;
+				}
+			}
+		}
+		
+		if (syntax->flags & HL_HIGHLIGHT_NUMBERS) {
+			if ((isdigit(c) && (prev_sep || prev_hl == HL_NUMBER)) || (c == '.' && prev_hl == HL_NUMBER)) {
+				hl[i] = HL_NUMBER;
+				i++;
+				prev_sep = 0;
+				continue;
+			}
+		}
+
+		if (prev_sep) {
+			int j;
+			for (j = 0; keywords[j]; j++) {
+				if (keywords[j][0] != c) continue;
+				int klen = strlen(keywords[j]);
+				int kw2 = keywords[j][klen - 1] == '|';
+				if (kw2) klen--;
+
+				if (!strncmp(&row->render[i], keywords[j], klen) && is_separator(row->render[i + klen])) {
+					memset(&hl[i], kw2 ? HL_KEYWORD2 : HL_KEYWORD1, klen);
+					i += klen;
+					break;
+				}
+			}
+			if (keywords[j] != NULL) {
+				prev_sep = 0;
+				continue;
+			}
+		}
+
+		prev_sep = is_separator(c);
+		i++;
+	}
+
+	return in_comment;
+}
+
+void editorUpdateSyntax(efile * F, erow * row) {
+	unsigned long start = editorStatStart();
+	while (1) {
+		row->hl = realloc(row->hl, row->rsize);
+		int in_comment = (row->idx > 0 && F->row[row->idx - 1].hl_open_comment);
+		in_comment = editorHighlightRow(F->syntax, row, row->hl, in_comment);
+		editorRowBrackets(row);
+		editorBracketTouch(F, row->idx);
+
+		int changed = (row->hl_open_comment != in_comment);
+		row->hl_open_comment = in_comment;
+		ST.rowshighlighted++;
+		if (!changed || row->idx + 1 >= F->numrows) break;
+		row = &F->row[row->idx + 1];
+	}
+	editorStatEnd(STAT_HIGHLIGHT, start);
+}
+
+void editorHighlightChunk(void * arg, int j) {
+	hlChunk * C = &((hlChunk *) arg)[j];
+	efile * F = C->file;
+	unsigned char * scratch = NULL;
+	int scratchsize = 0;
+
+	/* highlight assuming no open comment, and follow the other
+	 * assumption only until both end a row in the same state */
+	int s0 = C->in_comment;
+	int s1 = 1;
+	C->converged = (j == 0) ? C->end : -1;
+	for (int i = C->start; i < C->end; i++) {
+		erow * row = &F->row[i];
+		row->hl = realloc(row->hl, row->rsize);
+		s0 = editorHighlightRow(F->syntax, row, row->hl, s0);
+		row->hl_open_comment = s0;
+		editorRowBrackets(row);
+		if (C->converged == -1) {
+			if (row->rsize > scratchsize) {
+				scratchsize = row->rsize;
+				scratch = realloc(scratch, scratchsize);
+			}
+			s1 = editorHighlightRow(F->syntax, row, scratch, s1);
+			if (s1 == s0) C->converged = i;
+		}
+	}
+	C->out0 = s0;
+	C->out1 = (C->converged == -1) ? s1 : s0;
+	free(scratch);
+}
+
+void editorFixupChunk(void * arg, int j) {
+	hlChunk * C = &((hlChunk *) arg)[j];
+	efile * F = C->file;
+	if (!C->fixup) return;
+
+	int end = (C->converged == -1) ? C->end : C->converged + 1;
+	int in_comment = 1;
+	for (int i = C->start; i < end; i++) {
+		erow * row = &F->row[i];
+		in_comment = editorHighlightRow(F->syntax, row, row->hl, in_comment);
+		row->hl_open_comment = in_comment;
+		editorRowBrackets(row);
+	}
+}
+
+void editorHighlightRows(efile * F, int start, int end) {
+	if (start >= end) return;
+	unsigned long stat = editorStatStart();
+	int in_comment = (start > 0 && F->row[start - 1].hl_open_comment);
+	int open_comment = F->row[end - 1].hl_open_comment;
+	int numchunks = (end - start) / KILO_HL_CHUNK_MIN;
+	if (numchunks > 1 && numchunks > editorPoolSize()) numchunks = editorPoolSize();
+
+	if (numchunks <= 1) {
+		for (int i = start; i < end; i++) {
+			erow * row = &F->row[i];
+			row->hl = realloc(row->hl, row->rsize);
+			in_comment = editorHighlightRow(F->syntax, row, row->hl, in_comment);
+			row->hl_open_comment = in_comment;
+			editorRowBrackets(row);
+		}
+	} else {
+		hlChunk * chunks = malloc(sizeof(hlChunk) * numchunks);
+		for (int c = 0; c < numchunks; c++) {
+			chunks[c].file = F;
+			chunks[c].start = start + (long) (end - start) * c / numchunks;
+			chunks[c].end = start + (long) (end - start) * (c + 1) / numchunks;
+			chunks[c].in_comment = (c == 0) ? in_comment : 0;
+			chunks[c].fixup = 0;
+		}
+		editorPoolRun(editorHighlightChunk, chunks, numchunks);
+
+		/* stitch: the real incoming state of each chunk follows from its
+		 * predecessor; chunks that were wrong redo their unconverged prefix */
+		int state = chunks[0].out0;
+		for (int c = 1; c < numchunks; c++) {
+			chunks[c].fixup = state;
+			state = state ? chunks[c].out1 : chunks[c].out0;
+		}
+		editorPoolRun(editorFixupChunk, chunks, numchunks);
+		free(chunks);
+	}
+
+	ST.rowshighlighted += end - start;
+	editorBracketRange(F, start, end);
+	editorStatEnd(STAT_HIGHLIGHT, stat);
+
+	if (end < F->numrows && F->row[end - 1].hl_open_comment != open_comment) editorUpdateSyntax(F, &F->row[end]);
+}
+
+void editorSelectSyntaxHighlight(efile * F) {
+	if (F->source) return;
+	F->syntax = NULL;
+	editorColumnsStop(F);
+	if (F->filename == NULL) return;
+	
+	char * ext = strrchr(F->filename, '.');
+
+	for (unsigned int j = 0; j < HLDB_ENTRIES; j++) {
+		struct editorSyntax * s = &HLDB[j];
+		unsigned int i = 0;
+		while (s->filematch[i]) {
+			int is_ext = (s->filematch[i][0] == '.');
+			if ((is_ext && ext && !strcmp(ext, s->filematch[i])) || (!is_ext && strstr(F->filename, s->filematch[i]))) {
+				F->syntax = s;
+				/* delimited data opens aligned in columns */
+				if (editorFieldSeparator(s)) editorColumnsStart(F);
+				if (F->pager) editorPagerDrop(F);
+				else editorHighlightRows(F, 0, F->numrows);
+				return;
+			}
+			i++;
+		}
+	}
+}
+
+/*** fold ranges ***/
+
+/* a brace the highlighter left as code, not inside a string or comment */
+int editorIsBrace(erow * row, int j, char brace) {
+	return row->render[j] == brace && (row->hl == NULL || row->hl[j] == HL_NORMAL);
+}
+
+/* block opened by the first brace left open on row at, or else by the
+ * nearest brace above that is still open there */
+int editorBraceRange(efile * F, int at, int * start, int * end) {
+	int open = -1, pos = -1;
+	erow * row = editorFileRow(F, at);
+	int depth = 0;
+	for (int j = row->rsize - 1; j >= 0; j--) {
+		if (editorIsBrace(row, j, '}')) depth++;
+		else if (editorIsBrace(row, j, '{')) {
+			if (depth == 0) {
+				open = at;
+				pos = j;
+			} else {
+				depth--;
+			}
+		}
+	}
+	depth = 0;
+	for (int r = at - 1; r >= 0 && open == -1; r--) {
+		row = editorFileRow(F, r);
+		for (int j = row->rsize - 1; j >= 0; j--) {
+			if (editorIsBrace(row, j, '}')) depth++;
+			else if (editorIsBrace(row, j, '{') && depth-- == 0) {
+				open = r;
+				pos = j;
+				break;
+			}
+		}
+	}
+	if (open == -1) return -1;
+
+	depth = 1;
+	int r = open;
+	row = editorFileRow(F, r);
+	int j = pos + 1;
+	while (1) {
+		if (j == row->rsize) {
+			if (++r == F->numrows) break;
+			row = editorFileRow(F, r);
+			j = 0;
+			continue;
+		}
+		if (editorIsBrace(row, j, '{')) depth++;
+		else if (editorIsBrace(row, j, '}') && --depth == 0) break;
+		j++;
+	}
+	if (r == F->numrows) r--;
+	else {
+		/* a closing row that opens the next block, as "} else {" does, stays out */
+		for (j++; j < row->rsize; j++) {
+			if (editorIsBrace(row, j, '{')) {
+				r--;
+				break;
+			}
+		}
+	}
+	*start = open;
+	*end = r;
+	return 0;
+}
+
+/* indentation of a row, -1 for a blank one */
+int editorRowIndent(erow * row) {
+	int j = 0;
+	while (j < row->rsize && isspace((unsigned char) row->render[j])) j++;
+	return j == row->rsize ? -1 : j;
+}
+
+/* block of rows indented deeper than the row that introduces it */
+int editorIndentRange(efile * F, int at, int * start, int * end) {
+	int r = at;
+	while (r < F->numrows && editorRowIndent(editorFileRow(F, r)) == -1) r++;
+	if (r == F->numrows) return -1;
+	int indent = editorRowIndent(editorFileRow(F, r));
+
+	/* the row opens a block if the next non-blank row is deeper, else the
+	 * block is the one it belongs to */
+	int next = r + 1;
+	while (next < F->numrows && editorRowIndent(editorFileRow(F, next)) == -1) next++;
+	int open = -1;
+	if (r == at && next < F->numrows && editorRowIndent(editorFileRow(F, next)) > indent) {
+		open = at;
+	} else {
+		for (int up = at - 1; up >= 0; up--) {
+			int i = editorRowIndent(editorFileRow(F, up));
+			if (i != -1 && i < indent) {
+				open = up;
+				break;
+			}
+		}
+	}
+	if (open == -1) return -1;
+
+	int base = editorRowIndent(editorFileRow(F, open));
+	int last = open;
+	for (r = open + 1; r < F->numrows; r++) {
+		int i = editorRowIndent(editorFileRow(F, r));
+		if (i == -1) continue;
+		if (i <= base) break;
+		last = r;
+	}
+	if (last == open) return -1;
+	*start = open;
+	*end = last;
+	return 0;
+}
+
+/* rows a fold around at would cover, the first of them staying visible;
+ * -1 when at is in no block */
+int editorFoldRange(efile * F, int at, int * start, int * end) {
+	if (at >= F->numrows) return -1;
+	int ret;
+	if (F->syntax && (F->syntax->flags & HL_FOLD_BRACES)) ret = editorBraceRange(F, at, start, end);
+	else ret = editorIndentRange(F, at, start, end);
+	if (ret == -1 || *end <= *start) return -1;
+	return 0;
+}
@@ -0,0 +1,254 @@
+#include "kilo.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*** characters ***/
+
+struct editorRange {
+	int lo;
+	int hi;
+};
+
+/* marks drawn over the character before them and joiners */
+struct editorRange editorZeroWidth[] = {
+	{0x0300, 0x036F}, {0x0483, 0x0489}, {0x0591, 0x05BD}, {0x05BF, 0x05BF},
+	{0x05C1, 0x05C2}, {0x05C4, 0x05C5}, {0x05C7, 0x05C7}, {0x0610, 0x061A},
+	{0x064B, 0x065F}, {0x0670, 0x0670}, {0x06D6, 0x06DC}, {0x06DF, 0x06E4},
+	{0x06E7, 0x06E8}, {0x06EA, 0x06ED}, {0x0900, 0x0902}, {0x093A, 0x093A},
+	{0x093C, 0x093C}, {0x0941, 0x0948}, {0x094D, 0x094D}, {0x0951, 0x0957},
+	{0x0E31, 0x0E31}, {0x0E34, 0x0E3A}, {0x0E47, 0x0E4E}, {0x1160, 0x11FF},
+	{0x1AB0, 0x1AFF}, {0x1DC0, 0x1DFF}, {0x200B, 0x200F}, {0x202A, 0x202E},
+	{0x2060, 0x2064}, {0x20D0, 0x20FF}, {0x302A, 0x302D}, {0x3099, 0x309A},
+	{0xFE00, 0xFE0F}, {0xFE20, 0xFE2F}, {0xFEFF, 0xFEFF}, {0x1F3FB, 0x1F3FF},
+	{0xE0000, 0xE0FFF}
+};
+
+/* east asian wide and fullwidth characters and emoji */
+struct editorRange editorDoubleWidth[] = {
+	{0x1100, 0x115F}, {0x231A, 0x231B}, {0x2329, 0x232A}, {0x23E9, 0x23EC},
+	{0x23F0, 0x23F0}, {0x23F3, 0x23F3}, {0x25FD, 0x25FE}, {0x2614, 0x2615},
+	{0x2648, 0x2653}, {0x267F, 0x267F}, {0x2693, 0x2693}, {0x26A1, 0x26A1},
+	{0x26AA, 0x26AB}, {0x26BD, 0x26BE}, {0x26C4, 0x26C5}, {0x26CE, 0x26CE},
+	{0x26D4, 0x26D4}, {0x26EA, 0x26EA}, {0x26F2, 0x26F3}, {0x26F5, 0x26F5},
+	{0x26FA, 0x26FA}, {0x26FD, 0x26FD}, {0x2705, 0x2705}, {0x270A, 0x270B},
+	{0x2728, 0x2728}, {0x274C, 0x274C}, {0x274E, 0x274E}, {0x2753, 0x2755},
+	{0x2757, 0x2757}, {0x2795, 0x2797}, {0x27B0, 0x27B0}, {0x27BF, 0x27BF},
+	{0x2B1B, 0x2B1C}, {0x2B50, 0x2B50}, {0x2B55, 0x2B55}, {0x2E80, 0x303E},
+	{0x3041, 0x33FF}, {0x3400, 0x4DBF}, {0x4E00, 0x9FFF}, {0xA000, 0xA4CF},
+	{0xA960, 0xA97F}, {0xAC00, 0xD7A3}, {0xF900, 0xFAFF}, {0xFE10, 0xFE19},
+	{0xFE30, 0xFE6F}, {0xFF00, 0xFF60}, {0xFFE0, 0xFFE6}, {0x16FE0, 0x16FE4},
+	{0x17000, 0x18AFF}, {0x1B000, 0x1B2FF}, {0x1F004, 0x1F004}, {0x1F0CF, 0x1F0CF},
+	{0x1F18E, 0x1F18E}, {0x1F191, 0x1F19A}, {0x1F200, 0x1F251}, {0x1F300, 0x1F64F},
+	{0x1F680, 0x1F6FF}, {0x1F7E0, 0x1F7EB}, {0x1F90C, 0x1F9FF}, {0x1FA70, 0x1FAFF},
+	{0x20000, 0x2FFFD}, {0x30000, 0x3FFFD}
+};
+
+int editorInRange(struct editorRange * r, int n, int cp) {
+	int lo = 0, hi = n;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (r[mid].hi < cp) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo < n && r[lo].lo <= cp;
+}
+
+/* columns a code point takes; controls and undecodable bytes are drawn as
+ * one marked column */
+int editorCharWidth(int cp) {
+	if (cp < 0x300) return 1;
+	if (editorInRange(editorZeroWidth, sizeof(editorZeroWidth) / sizeof(editorZeroWidth[0]), cp)) return 0;
+	if (editorInRange(editorDoubleWidth, sizeof(editorDoubleWidth) / sizeof(editorDoubleWidth[0]), cp)) return 2;
+	return 1;
+}
+
+/* bytes of the code point at s, with *cp set to -1 for a byte that does
+ * not start a valid sequence */
+int editorUtf8Decode(const char * s, int len, int * cp) {
+	const unsigned char * u = (const unsigned char *) s;
+	int n, c, min;
+	if (u[0] < 0x80) {
+		*cp = u[0];
+		return 1;
+	} else if ((u[0] & 0xE0) == 0xC0) {
+		n = 2; c = u[0] & 0x1F; min = 0x80;
+	} else if ((u[0] & 0xF0) == 0xE0) {
+		n = 3; c = u[0] & 0x0F; min = 0x800;
+	} else if ((u[0] & 0xF8) == 0xF0) {
+		n = 4; c = u[0] & 0x07; min = 0x10000;
+	} else {
+		*cp = -1;
+		return 1;
+	}
+	if (n > len) {
+		*cp = -1;
+		return 1;
+	}
+	for (int i = 1; i < n; i++) {
+		if ((u[i] & 0xC0) != 0x80) {
+			*cp = -1;
+			return 1;
+		}
+		c = (c << 6) | (u[i] & 0x3F);
+	}
+	if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+		*cp = -1;
+		return 1;
+	}
+	*cp = c;
+	return n;
+}
+
+/*** rows ***/
+
+/* tabs in s, returning whether any byte is outside ASCII; sixteen bytes a
+ * step where SSE2 is available, so ASCII rows cost no more than before */
+int editorScanChars(const char * s, int len, int * tabs) {
+	int j = 0, t = 0, high = 0;
+#ifdef __SSE2__
+	__m128i tab = _mm_set1_epi8('\t');
+	for (; j + 16 <= len; j += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) &s[j]);
+		high |= _mm_movemask_epi8(v);
+		t += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, tab)));
+	}
+#endif
+	for (; j < len; j++) {
+		high |= (unsigned char) s[j] & 0x80;
+		if (s[j] == '\t') t++;
+	}
+	*tabs = t;
+	return high != 0;
+}
+
+int editorIsRegional(int cp) {
+	return cp >= 0x1F1E6 && cp <= 0x1F1FF;
+}
+
+/* the column of each render byte for a row with UTF-8 in it: every byte of
+ * a grapheme cluster (a character, the marks on it, a sequence joined by
+ * ZWJ or a flag) holds the column the cluster starts at, so a cluster
+ * boundary is where the column changes; ASCII never joins a cluster, and
+ * ASCII rows keep no table */
+void editorRowColumns(erow * row, int utf8) {
+	if (!utf8) {
+		free(row->rcol);
+		row->rcol = NULL;
+		return;
+	}
+	row->rcol = realloc(row->rcol, sizeof(int) * (row->rsize + 1));
+	int col = 0, start = 0, prev = -1, flag = 0;
+	for (int j = 0; j < row->rsize;) {
+		int cp;
+		int n = editorUtf8Decode(&row->render[j], row->rsize - j, &cp);
+		int width = (cp < 0) ? 1 : editorCharWidth(cp);
+		int join = 0;
+		if (cp < 0x80) {
+			flag = 0;
+		} else if (j == 0 && width == 0) {
+			/* a mark with nothing under it stands on its own */
+			width = 1;
+			cp = -1;
+		} else if (prev == 0x200D) {
+			join = 1;
+			width = 0;
+		} else if (width == 0) {
+			join = 1;
+		} else if (flag && editorIsRegional(cp)) {
+			join = 1;
+			flag = 0;
+		} else {
+			flag = editorIsRegional(cp);
+		}
+		if (!join) start = col;
+		for (int k = 0; k < n; k++) row->rcol[j + k] = start;
+		col += width;
+		prev = cp;
+		j += n;
+	}
+	row->rcol[row->rsize] = col;
+}
+
+/* render offset just past the cluster starting at render offset ro */
+int editorRowClusterEnd(erow * row, int ro) {
+	if (ro >= row->rsize) return row->rsize;
+	if (row->rcol == NULL) return ro + 1;
+	int end = ro + 1;
+	while (end < row->rsize && row->rcol[end] == row->rcol[ro]) end++;
+	return end;
+}
+
+int editorRowCxToRender(erow * row, int cx) {
+	int ro = 0;
+	for (int j = 0; j < cx; j++) {
+		if (row->chars[j] == '\t') ro += (KILO_TAB_STOP - 1) - (ro % KILO_TAB_STOP);
+		ro++;
+	}
+	return ro;
+}
+
+/* the character whose render covers render offset ro */
+int editorRowRenderToCx(erow * row, int ro) {
+	int cur = 0;
+	int cx;
+	for (cx = 0; cx < row->size; cx++) {
+		if (row->chars[cx] == '\t') cur += (KILO_TAB_STOP - 1) - (cur % KILO_TAB_STOP);
+		cur++;
+		if (cur > ro) return cx;
+	}
+	return cx;
+}
+
+int editorRowRenderToRx(erow * row, int ro) {
+	if (row->rcol == NULL) return ro;
+	if (ro > row->rsize) ro = row->rsize;
+	return row->rcol[ro];
+}
+
+/* the render offset of the cluster covering screen column rx */
+int editorRowRxToRender(erow * row, int rx) {
+	if (row->rcol == NULL) return rx;
+	if (rx >= row->rcol[row->rsize] && row->rcol[row->rsize] > 0) return row->rsize;
+	int lo = 0, hi = row->rsize;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (row->rcol[mid] <= rx) lo = mid + 1;
+		else hi = mid;
+	}
+	int ro = lo - 1;
+	while (ro > 0 && row->rcol[ro - 1] == row->rcol[ro]) ro--;
+	return ro;
+}
+
+int editorRowCxToRx(erow * row, int cx) {
+	return editorRowRenderToRx(row, editorRowCxToRender(row, cx));
+}
+
+int editorRowRxToCx(erow * row, int rx) {
+	return editorRowRenderToCx(row, editorRowRxToRender(row, rx));
+}
+
+/* cursor steps over whole clusters; a tab is one character of its own */
+int editorRowNextCx(erow * row, int cx) {
+	if (cx >= row->size) return row->size;
+	if (row->rcol == NULL) return cx + 1;
+	/* marks after a tab go with the last space it expands to */
+	int ro = (row->chars[cx] == '\t') ? editorRowCxToRender(row, cx + 1) - 1 : editorRowCxToRender(row, cx);
+	return editorRowRenderToCx(row, editorRowClusterEnd(row, ro));
+}
+
+int editorRowPrevCx(erow * row, int cx) {
+	if (cx <= 0) return 0;
+	if (row->rcol == NULL || row->chars[cx - 1] == '\t') return cx - 1;
+	int ro = editorRowCxToRender(row, cx) - 1;
+	while (ro > 0 && row->rcol[ro - 1] == row->rcol[ro]) ro--;
+	return editorRowRenderToCx(row, ro);
+}
+
+/* the start of the cluster cx falls in, for a cursor moved between rows */
+int editorRowClusterCx(erow * row, int cx) {
+	if (row->rcol == NULL || cx <= 0 || cx >= row->size) return cx;
+	return editorRowPrevCx(row, editorRowNextCx(row, cx));
+}
@@ -0,0 +1,233 @@
+#include "kilo.h"
+
+/*** data ***/
+
+struct editorWord {
+	char * s;
+	int len;
+	int count;
+};
+
+/* one index shared by every buffer: words keep their id until the index is
+ * compacted, the hash finds a word's id and sorted holds the ids merged so
+ * far in string order; ids from merged on are new words not yet sorted */
+struct editorWords {
+	struct editorWord * word;
+	int numwords;
+	int cap;
+	int live;
+	int * table;
+	int tablecap;
+	int * sorted;
+	int numsorted;
+	int merged;
+};
+
+struct editorWords W = {0};
+
+/*** words ***/
+
+int editorIsWordChar(int c) {
+	return c >= 0x80 || ((isalnum(c) || c == '_') && !is_separator(c));
+}
+
+unsigned int editorWordHash(char * s, int len) {
+	unsigned int h = 2166136261u;
+	for (int i = 0; i < len; i++) h = (h ^ (unsigned char) s[i]) * 16777619u;
+	return h;
+}
+
+void editorWordsRehash(int tablecap) {
+	free(W.table);
+	W.tablecap = tablecap;
+	W.table = malloc(sizeof(int) * tablecap);
+	memset(W.table, -1, sizeof(int) * tablecap);
+	for (int id = 0; id < W.numwords; id++) {
+		unsigned int h = editorWordHash(W.word[id].s, W.word[id].len) & (tablecap - 1);
+		while (W.table[h] != -1) h = (h + 1) & (tablecap - 1);
+		W.table[h] = id;
+	}
+}
+
+/* id of a word, added with a count of 0 when create is set, or -1 */
+int editorWordId(char * s, int len, int create) {
+	if (W.tablecap == 0) {
+		if (!create) return -1;
+		editorWordsRehash(1024);
+	}
+	unsigned int h = editorWordHash(s, len) & (W.tablecap - 1);
+	for (; W.table[h] != -1; h = (h + 1) & (W.tablecap - 1)) {
+		struct editorWord * w = &W.word[W.table[h]];
+		if (w->len == len && memcmp(w->s, s, len) == 0) return W.table[h];
+	}
+	if (!create) return -1;
+
+	if (W.numwords == W.cap) {
+		W.cap = W.cap ? W.cap * 2 : 1024;
+		W.word = realloc(W.word, sizeof(struct editorWord) * W.cap);
+	}
+	int id = W.numwords++;
+	W.word[id].s = malloc(len + 1);
+	memcpy(W.word[id].s, s, len);
+	W.word[id].s[len] = '\0';
+	W.word[id].len = len;
+	W.word[id].count = 0;
+	if (W.numwords * 2 > W.tablecap) editorWordsRehash(W.tablecap * 2);
+	else W.table[h] = id;
+	return id;
+}
+
+/* add (delta 1) or remove (delta -1) the identifiers in a span of text:
+ * runs of word characters of at least two bytes not starting with a digit */
+void editorWordsText(char * s, int len, int delta) {
+	int i = 0;
+	while (i < len) {
+		if (!editorIsWordChar((unsigned char) s[i])) {
+			i++;
+			continue;
+		}
+		int start = i;
+		while (i < len && editorIsWordChar((unsigned char) s[i])) i++;
+		if (isdigit((unsigned char) s[start]) || i - start < 2 || i - start > KILO_WORD_MAX) continue;
+		int id = editorWordId(&s[start], i - start, delta > 0);
+		if (id == -1 || W.word[id].count + delta < 0) continue;
+		if (W.word[id].count == 0) W.live++;
+		W.word[id].count += delta;
+		if (W.word[id].count == 0) W.live--;
+	}
+}
+
+/*** completion ***/
+
+int editorWordCmp(int a, int b) {
+	struct editorWord * x = &W.word[a];
+	struct editorWord * y = &W.word[b];
+	int r = memcmp(x->s, y->s, x->len < y->len ? x->len : y->len);
+	return r ? r : x->len - y->len;
+}
+
+int editorWordIdCmp(const void * a, const void * b) {
+	return editorWordCmp(*(const int *) a, *(const int *) b);
+}
+
+/* words no buffer holds any more are dropped once they outnumber the rest */
+void editorWordsCompact() {
+	int n = 0;
+	for (int id = 0; id < W.numwords; id++) {
+		if (W.word[id].count == 0) free(W.word[id].s);
+		else W.word[n++] = W.word[id];
+	}
+	W.numwords = n;
+	W.merged = 0;
+	W.numsorted = 0;
+	editorWordsRehash(W.tablecap);
+}
+
+/* new words are merged into the sorted ids once there are enough of them
+ * to pay for it, until then completion scans them directly */
+void editorWordsMerge() {
+	if (W.numwords - W.live > W.live + 4096) editorWordsCompact();
+	int pending = W.numwords - W.merged;
+	if (pending <= 256 && pending * 64 <= W.numsorted) return;
+
+	W.sorted = realloc(W.sorted, sizeof(int) * W.numwords);
+	int * fresh = malloc(sizeof(int) * pending);
+	for (int i = 0; i < pending; i++) fresh[i] = W.merged + i;
+	qsort(fresh, pending, sizeof(int), editorWordIdCmp);
+
+	int i = W.numsorted - 1, j = pending - 1, k = W.numsorted + pending - 1;
+	while (j >= 0) {
+		if (i >= 0 && editorWordCmp(W.sorted[i], fresh[j]) > 0) W.sorted[k--] = W.sorted[i--];
+		else W.sorted[k--] = fresh[j--];
+	}
+	free(fresh);
+	W.numsorted += pending;
+	W.merged = W.numwords;
+}
+
+int editorWordPrefix(int id, char * prefix, int len) {
+	return W.word[id].len > len && memcmp(W.word[id].s, prefix, len) == 0;
+}
+
+/* up to max words in the index that extend prefix, in order; the strings
+ * stay valid until the index next changes */
+int editorWordsComplete(char * prefix, int len, char ** out, int max) {
+	if (max <= 0) return 0;
+	editorWordsMerge();
+
+	int lo = 0, hi = W.numsorted;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		struct editorWord * w = &W.word[W.sorted[mid]];
+		int r = memcmp(w->s, prefix, w->len < len ? w->len : len);
+		if (r < 0 || (r == 0 && w->len < len)) lo = mid + 1;
+		else hi = mid;
+	}
+
+	int * ids = malloc(sizeof(int) * (max + W.numwords - W.merged));
+	int n = 0;
+	for (int i = lo; i < W.numsorted && n < max; i++) {
+		int id = W.sorted[i];
+		if (memcmp(W.word[id].s, prefix, W.word[id].len < len ? W.word[id].len : len) != 0) break;
+		if (W.word[id].count > 0 && W.word[id].len > len) ids[n++] = id;
+	}
+	int found = n;
+	for (int id = W.merged; id < W.numwords; id++) {
+		if (W.word[id].count > 0 && editorWordPrefix(id, prefix, len)) ids[n++] = id;
+	}
+	if (n > found) qsort(ids, n, sizeof(int), editorWordIdCmp);
+	if (n > max) n = max;
+	for (int i = 0; i < n; i++) out[i] = W.word[ids[i]].s;
+	free(ids);
+	return n;
+}
+
+int editorWordsCount() {
+	return W.live;
+}
+
+/*** buffer tracking ***/
+
+/* rows above F->wordrows are counted in the index, the rest are scanned in
+ * the background; -1 leaves the buffer out */
+
+void editorWordsInsert(efile * F, int at) {
+	if (F->wordrows == -1) return;
+	if (at < F->wordrows || F->wordrows == F->numrows) F->wordrows++;
+}
+
+void editorWordsDelete(efile * F, erow * row) {
+	if (row->idx >= F->wordrows) return;
+	editorWordsText(row->chars, row->size, -1);
+	F->wordrows--;
+}
+
+/* a counted row's identifiers leave the index before its chars change and
+ * enter it again after, read from the chars both times */
+void editorWordsLeave(efile * F, erow * row) {
+	if (row->idx < F->wordrows) editorWordsText(row->chars, row->size, -1);
+}
+
+void editorWordsEnter(efile * F, erow * row) {
+	if (row->idx < F->wordrows) editorWordsText(row->chars, row->size, 1);
+}
+
+/* count rows for up to budget ms, returns 1 once the whole buffer is in */
+int editorWordsScan(efile * F, long budget) {
+	if (F->pager || F->hex || F->source || F->loader) return 1;
+	if (F->wordrows == -1) F->wordrows = 0;
+	long deadline = editorMonotonicMs() + budget;
+	while (F->wordrows < F->numrows) {
+		erow * row = &F->row[F->wordrows++];
+		editorWordsText(row->chars, row->size, 1);
+		if ((F->wordrows & 1023) == 0 && editorMonotonicMs() >= deadline) return 0;
+	}
+	/* sort what the scan found now rather than on the first completion */
+	editorWordsMerge();
+	return 1;
+}
+
+void editorWordsForget(efile * F) {
+	for (int i = 0; i < F->wordrows; i++) editorWordsText(F->row[i].chars, F->row[i].size, -1);
+	F->wordrows = -1;
+}